@@ -1,9 +1,16 @@
 const builtin = @import("builtin");
 const std = @import("std");
 
+const Precision = enum { f32, f64, mixed };
+
 pub fn build(b: *std.Build) void {
     const target = b.standardTargetOptions(.{});
     const optimize = b.standardOptimizeOption(.{});
+    const precision = b.option(
+        Precision,
+        "precision",
+        "Scalar type of the physics: f32, f64, or f64 positions with f32 forces",
+    ) orelse .f32;
 
     const exe = b.addExecutable(.{
         .name = "nbody2",
@@ -12,6 +19,10 @@ pub fn build(b: *std.Build) void {
         .optimize = optimize,
     });
 
+    const options = b.addOptions();
+    options.addOption(Precision, "precision", precision);
+    exe.root_module.addOptions("build_options", options);
+
     const raylib_build = @import("raylib_build.zig");
     const raylib = raylib_build.addRaylib(b, target, .ReleaseFast, .{});
     exe.linkLibrary(raylib);
@@ -26,4 +37,14 @@ pub fn build(b: *std.Build) void {
     }
 
     b.installArtifact(exe);
+
+    const tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/tests.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    tests.root_module.addOptions("build_options", options);
+    const run_tests = b.addRunArtifact(tests);
+    const test_step = b.step("test", "Run the unit tests");
+    test_step.dependOn(&run_tests.step);
 }
@@ -0,0 +1,129 @@
+const Benchmark = @import("bench.zig").Benchmark;
+const FastMultipole = @import("FastMultipole.zig");
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const std = @import("std");
+
+headless: bool = false,
+bench: ?Benchmark = null,
+steps: u64 = 1000,
+step_rate: f32 = Sim.default_step_rate,
+solver: Sim.Solver = .direct,
+integrator: Sim.Integrator = .euler,
+collisions: Sim.Collisions = .none,
+ccd: bool = false,
+theta: f32 = 0.5,
+mesh_size: usize = 256,
+fmm_order: usize = 6,
+reorder_interval: u32 = 0,
+reorder_curve: Sim.Curve = .hilbert,
+softening: f32 = Sim.default_softening,
+threads: usize = 0,
+load: ?[]const u8 = null,
+save: ?[]const u8 = null,
+scene: Sim.Scene = .random,
+bodies: usize = 0,
+seed: u64 = 0,
+
+/// Fills every field from a `--field-name value` flag on the command line.
+/// Boolean fields are plain switches.
+pub fn parse(allocator: std.mem.Allocator) !@This() {
+    var result = @This(){};
+
+    var args = try std.process.argsWithAllocator(allocator);
+    defer args.deinit();
+    _ = args.skip();
+
+    next_arg: while (args.next()) |arg| {
+        if (std.mem.eql(u8, arg, "--help")) usage(null);
+        if (!std.mem.startsWith(u8, arg, "--")) usage(arg);
+        const name = arg[2..];
+
+        inline for (@typeInfo(@This()).Struct.fields) |field| {
+            if (std.mem.eql(u8, flagName(field.name), name)) {
+                if (field.type == bool) {
+                    @field(result, field.name) = true;
+                } else {
+                    const value = args.next() orelse usage(arg);
+                    @field(result, field.name) = parseValue(
+                        field.type,
+                        allocator,
+                        value,
+                    ) catch usage(arg);
+                }
+                continue :next_arg;
+            }
+        }
+        usage(arg);
+    }
+
+    return result;
+}
+
+/// Checks the numeric physics flags and applies them to `sim`, along with a
+/// pool of `threads` threads. Solver, integrator and scene choices are left
+/// alone, so benchmarks can tune sims they set up themselves.
+pub fn tune(self: @This(), sim: *Sim) !void {
+    if (!(self.softening > 0)) return error.InvalidSoftening;
+    if (!(self.theta >= 0)) return error.InvalidTheta;
+    if (!(self.step_rate > 0)) return error.InvalidStepRate;
+    if (self.mesh_size < 2 or !std.math.isPowerOfTwo(self.mesh_size)) return error.InvalidMeshSize;
+    if (self.fmm_order < 1 or self.fmm_order > FastMultipole.max_order) return error.InvalidFmmOrder;
+    sim.dt = 1 / self.step_rate;
+    sim.theta = self.theta;
+    sim.mesh_size = self.mesh_size;
+    sim.fmm_order = self.fmm_order;
+    sim.softening = self.softening;
+    const pool = try Pool.create(sim.allocator, self.threads);
+    if (sim.pool) |old| old.destroy();
+    sim.pool = pool;
+}
+
+pub fn deinit(self: @This(), allocator: std.mem.Allocator) void {
+    inline for (@typeInfo(@This()).Struct.fields) |field| {
+        if (field.type == ?[]const u8) {
+            if (@field(self, field.name)) |value| allocator.free(value);
+        }
+    }
+}
+
+fn flagName(comptime field_name: []const u8) []const u8 {
+    comptime {
+        var name: [field_name.len]u8 = undefined;
+        for (field_name, &name) |field_char, *flag_char| {
+            flag_char.* = if (field_char == '_') '-' else field_char;
+        }
+        const final = name;
+        return &final;
+    }
+}
+
+fn parseValue(
+    comptime T: type,
+    allocator: std.mem.Allocator,
+    value: []const u8,
+) !T {
+    const Child = switch (@typeInfo(T)) {
+        .Optional => |optional| optional.child,
+        else => T,
+    };
+    return switch (@typeInfo(Child)) {
+        .Int => try std.fmt.parseInt(Child, value, 0),
+        .Float => try std.fmt.parseFloat(Child, value),
+        .Enum => std.meta.stringToEnum(Child, value) orelse
+            error.InvalidArgument,
+        .Pointer => try allocator.dupe(u8, value),
+        else => @compileError("unsupported argument type " ++ @typeName(T)),
+    };
+}
+
+fn usage(bad_arg: ?[]const u8) noreturn {
+    if (bad_arg) |arg| std.debug.print("invalid argument '{s}'\n", .{arg});
+    std.debug.print("usage: nbody2 [flags]\n", .{});
+    inline for (@typeInfo(@This()).Struct.fields) |field| {
+        std.debug.print("  --{s}", .{flagName(field.name)});
+        if (field.type != bool) std.debug.print(" <{s}>", .{@typeName(field.type)});
+        std.debug.print("\n", .{});
+    }
+    std.process.exit(if (bad_arg == null) 0 else 2);
+}
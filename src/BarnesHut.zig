@@ -0,0 +1,340 @@
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const kernel = @import("kernel.zig");
+const morton = @import("morton.zig");
+const std = @import("std");
+
+const Bodies = Sim.Bodies;
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+nodes: std.ArrayList(Node),
+/// Body indices sorted by Morton key, so every cell owns a consecutive run.
+order: std.ArrayList(u32),
+keys: std.ArrayList(morton.Key),
+scratch_keys: std.ArrayList(morton.Key),
+scratch: std.ArrayList(u32),
+/// One field of the bodies, or their IDs, while `sortBodies` permutes them.
+scratch_values: std.ArrayList(u64),
+
+const leaf_capacity = 8;
+const max_depth = morton.bits_per_axis;
+const nodes_per_chunk = 256;
+
+/// A square cell. Internal cells have four consecutive children starting at
+/// `first_child`; leaves own `order[start..end]`. The root is never a child,
+/// so `first_child == 0` marks a leaf.
+const Node = struct {
+    com: V2 = .{ 0, 0 },
+    mass: Real = 0,
+    center: V2,
+    size: Real,
+    first_child: u32 = 0,
+    start: u32,
+    end: u32,
+
+    inline fn contains(self: Node, pos: V2) bool {
+        const offset = @abs(pos - self.center);
+        return @reduce(.And, offset <= @as(V2, @splat(self.size / 2)));
+    }
+};
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{
+        .nodes = std.ArrayList(Node).init(allocator),
+        .order = std.ArrayList(u32).init(allocator),
+        .keys = std.ArrayList(morton.Key).init(allocator),
+        .scratch_keys = std.ArrayList(morton.Key).init(allocator),
+        .scratch = std.ArrayList(u32).init(allocator),
+        .scratch_values = std.ArrayList(u64).init(allocator),
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    self.nodes.deinit();
+    self.order.deinit();
+    self.keys.deinit();
+    self.scratch_keys.deinit();
+    self.scratch.deinit();
+    self.scratch_values.deinit();
+}
+
+/// Rebuilds the tree over `bodies`, splitting cells until they hold at most
+/// `leaf_capacity` bodies or reach `max_depth`. The bodies are sorted by
+/// Morton key on the pool, after which every cell is a run of the sorted
+/// keys. The nodes are then built a level at a time, each level's cells
+/// split in parallel by binary search on their keys, and summed bottom up
+/// the same way.
+pub fn build(self: *@This(), bodies: Bodies, pool: ?*Pool) !void {
+    self.nodes.clearRetainingCapacity();
+    try self.order.resize(bodies.len);
+    try self.keys.resize(bodies.len);
+    try self.scratch_keys.resize(bodies.len);
+    try self.scratch.resize(bodies.len);
+    for (self.order.items, 0..) |*index, i| index.* = @intCast(i);
+    if (bodies.len == 0) return;
+
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    var min = V2{ x[0], y[0] };
+    var max = min;
+    for (x[1..], y[1..]) |body_x, body_y| {
+        min = @min(min, V2{ body_x, body_y });
+        max = @max(max, V2{ body_x, body_y });
+    }
+    const extent = max - min;
+    const size = @max(extent[0], extent[1], 1e-6) * 1.001;
+    const center = min + @as(V2, @splat(size / 2));
+
+    morton.computeKeys(x, y, min, size, .morton, self.keys.items, pool);
+    morton.sort(self.keys.items, self.order.items, self.scratch_keys.items, self.scratch.items, pool);
+
+    try self.nodes.append(.{
+        .center = center,
+        .size = size,
+        .start = 0,
+        .end = @intCast(bodies.len),
+    });
+
+    // Each level's nodes follow the one before, so `levels[d]` is the first
+    // node at depth `d`.
+    var levels: [max_depth + 2]u32 = undefined;
+    levels[0] = 0;
+    var depth: u32 = 0;
+    while (true) : (depth += 1) {
+        const first: u32 = levels[depth];
+        const end: u32 = @intCast(self.nodes.items.len);
+        levels[depth + 1] = end;
+
+        var pass = LevelPass{
+            .nodes = self.nodes.items,
+            .keys = self.keys.items,
+            .first = first,
+            .depth = depth,
+        };
+        forEachNode(pool, end - first, pass, LevelPass.mark);
+        // Numbering the children is a scan over one flag per node; filling
+        // them in is the part worth spreading over the pool.
+        var next_child = end;
+        for (self.nodes.items[first..end]) |*node| {
+            if (node.first_child == 0) continue;
+            node.first_child = next_child;
+            next_child += 4;
+        }
+        if (next_child == end) break;
+        try self.nodes.resize(next_child);
+        pass.nodes = self.nodes.items;
+        forEachNode(pool, end - first, pass, LevelPass.split);
+    }
+
+    var sum = SumPass{
+        .nodes = self.nodes.items,
+        .order = self.order.items,
+        .x = x,
+        .y = y,
+        .mass = bodies.items(.mass),
+    };
+    // `depth` is the deepest level, whose nodes are all leaves.
+    var level = depth + 1;
+    while (level > 0) : (level -= 1) {
+        sum.first = levels[level - 1];
+        forEachNode(pool, levels[level] - sum.first, sum, SumPass.run);
+    }
+}
+
+fn forEachNode(
+    pool: ?*Pool,
+    len: usize,
+    context: anytype,
+    comptime func: fn (@TypeOf(context), usize, usize) void,
+) void {
+    if (pool) |p| {
+        p.parallelFor(len, nodes_per_chunk, context, func);
+    } else {
+        func(context, 0, len);
+    }
+}
+
+/// Moves `bodies` into the tree's order, so each cell owns a consecutive run
+/// of bodies and traversals walk memory in spatial order. `order` is the
+/// identity afterwards, so the tree stays valid.
+pub fn sortBodies(self: *@This(), bodies: Bodies, pool: ?*Pool) !void {
+    try self.scratch_values.resize(bodies.len);
+    bodies.permute(self.order.items, self.scratch_values.items, pool);
+    for (self.order.items, 0..) |*index, i| index.* = @intCast(i);
+}
+
+/// Splits the nodes of one level, `nodes[first..]`, all at `depth`.
+const LevelPass = struct {
+    nodes: []Node,
+    keys: []const morton.Key,
+    first: u32,
+    depth: u32,
+
+    /// Flags each node that needs children with a nonzero `first_child`.
+    fn mark(self: LevelPass, start: usize, end: usize) void {
+        for (self.nodes[self.first + start .. self.first + end]) |*node| {
+            const split = node.end - node.start > leaf_capacity and self.depth < max_depth;
+            node.first_child = @intFromBool(split);
+        }
+    }
+
+    /// Fills in the four children of each numbered node. Cells split on
+    /// successive bit pairs of the keys, so the children are consecutive runs
+    /// ordered by quadrant.
+    fn split(self: LevelPass, start: usize, end: usize) void {
+        const shift: u5 = @intCast(2 * (max_depth - 1 - self.depth));
+        for (self.nodes[self.first + start .. self.first + end]) |node| {
+            if (node.first_child == 0) continue;
+            const keys = self.keys[node.start..node.end];
+            var splits: [5]u32 = undefined;
+            splits[0] = node.start;
+            splits[4] = node.end;
+            for (1..4) |q| splits[q] = node.start + firstInQuadrant(keys, shift, q);
+
+            const child_size = node.size / 2;
+            for (self.nodes[node.first_child..][0..4], 0..) |*child, q| {
+                child.* = .{
+                    .center = node.center +
+                        quadrantDirection(q) * @as(V2, @splat(child_size / 2)),
+                    .size = child_size,
+                    .start = splits[q],
+                    .end = splits[q + 1],
+                };
+            }
+        }
+    }
+};
+
+/// Fills in the mass and centre of mass of the nodes of one level, from their
+/// bodies for leaves or from their already summed children.
+const SumPass = struct {
+    nodes: []Node,
+    order: []const u32,
+    x: []const Real,
+    y: []const Real,
+    mass: []const Real,
+    first: u32 = 0,
+
+    fn run(self: SumPass, start: usize, end: usize) void {
+        for (self.nodes[self.first + start .. self.first + end]) |*node| {
+            var mass: Real = 0;
+            var moment = V2{ 0, 0 };
+            if (node.first_child == 0) {
+                for (self.order[node.start..node.end]) |i| {
+                    mass += self.mass[i];
+                    moment += V2{ self.x[i], self.y[i] } * @as(V2, @splat(self.mass[i]));
+                }
+            } else {
+                for (self.nodes[node.first_child..][0..4]) |child| {
+                    mass += child.mass;
+                    moment += child.com * @as(V2, @splat(child.mass));
+                }
+            }
+            node.mass = mass;
+            node.com = if (mass > 0) moment / @as(V2, @splat(mass)) else node.center;
+        }
+    }
+};
+
+/// Index of the first key whose quadrant at `shift` is at least `q`.
+fn firstInQuadrant(keys: []const morton.Key, shift: u5, q: usize) u32 {
+    var low: usize = 0;
+    var high = keys.len;
+    while (low < high) {
+        const mid = (low + high) / 2;
+        if (((keys[mid] >> shift) & 3) < q) low = mid + 1 else high = mid;
+    }
+    return @intCast(low);
+}
+
+inline fn quadrantDirection(q: usize) V2 {
+    return .{
+        if (q & 1 != 0) 1 else -1,
+        if (q & 2 != 0) 1 else -1,
+    };
+}
+
+/// Acceleration of body `i` per unit of g. Cells are treated as point masses
+/// once their size over distance drops below `theta`; leaves are summed
+/// directly with the same softening as the pairwise solver. A cell holding
+/// body `i` itself is always opened, whatever `theta`, so a body never
+/// pulls on itself through its cell's centre of mass.
+pub fn accel(self: @This(), bodies: Bodies, i: usize, theta: Real, softening_sq: Real) V2 {
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const mass = bodies.items(.mass);
+    const pos = V2{ x[i], y[i] };
+
+    var result = V2{ 0, 0 };
+
+    var stack: [3 * max_depth + 4]u32 = undefined;
+    var stack_len: usize = 1;
+    stack[0] = 0;
+
+    while (stack_len > 0) {
+        stack_len -= 1;
+        const node = self.nodes.items[stack[stack_len]];
+        if (node.mass == 0) continue;
+
+        if (node.first_child == 0) {
+            for (self.order.items[node.start..node.end]) |j| {
+                const dist_xy = V2{ x[j], y[j] } - pos;
+                const dist_sq = dist_xy[0] * dist_xy[0] + dist_xy[1] * dist_xy[1] +
+                    softening_sq;
+                const dist = @sqrt(dist_sq);
+                result += dist_xy * @as(V2, @splat(mass[j] / (dist_sq * dist)));
+            }
+            continue;
+        }
+
+        const dist_xy = node.com - pos;
+        const dist_sq = dist_xy[0] * dist_xy[0] + dist_xy[1] * dist_xy[1];
+        if (!node.contains(pos) and node.size * node.size < theta * theta * dist_sq) {
+            const softened_sq = dist_sq + softening_sq;
+            const dist = @sqrt(softened_sq);
+            result += dist_xy * @as(V2, @splat(node.mass / (softened_sq * dist)));
+        } else {
+            for (0..4) |q| {
+                stack[stack_len] = node.first_child + @as(u32, @intCast(q));
+                stack_len += 1;
+            }
+        }
+    }
+
+    return result;
+}
+
+test "accel opens cells holding the body even when theta would accept them" {
+    const allocator = std.testing.allocator;
+    const softening = 1e-4;
+
+    // A lone body in one corner and a tight clump in the opposite one. The
+    // root's centre of mass sits near the clump, far enough from the lone
+    // body for theta = 1 to accept the root, which holds the body itself.
+    var bodies = Bodies.init(allocator);
+    defer bodies.deinit();
+    try bodies.append(.{ .mass = 1, .radius = 1e-4, .pos = .{ 0, 0 } });
+    var prng = std.rand.DefaultPrng.init(2);
+    const random = prng.random();
+    for (0..leaf_capacity + 1) |_| {
+        try bodies.append(.{
+            .mass = 1,
+            .radius = 1e-4,
+            .pos = .{ 1 + 1e-3 * random.float(Real), 1 + 1e-3 * random.float(Real) },
+        });
+    }
+
+    var tree = init(allocator);
+    defer tree.deinit();
+    try tree.build(bodies, null);
+
+    const exact = kernel.accelScalar(.{
+        .x = bodies.items(.x),
+        .y = bodies.items(.y),
+        .mass = bodies.items(.mass),
+        .softening_sq = softening * softening,
+    }, 0);
+    const diff = tree.accel(bodies, 0, 1, softening * softening) - exact;
+    try std.testing.expect(@reduce(.Add, diff * diff) < 1e-8 * @reduce(.Add, exact * exact));
+}
@@ -0,0 +1,364 @@
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const SlotMap = @import("SlotMap.zig");
+const VirtualMemory = @import("VirtualMemory.zig");
+const std = @import("std");
+
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+allocator: std.mem.Allocator,
+len: usize = 0,
+/// Bodies with committed memory behind them.
+capacity: usize = 0,
+/// Bodies `memory` has address space for.
+reserved: usize = 0,
+/// Address space for `reserved` bodies of every field, sized from the
+/// capacity asked for with plenty of headroom. Growing commits more of each
+/// field's range in place, so the arrays only move in the rare case that
+/// the reservation runs out, when a larger one replaces it.
+memory: ?VirtualMemory = null,
+arrays: [field_count][*]align(cache_line) Real = undefined,
+/// Stable ID of each body. Unlike indices, IDs survive removals and
+/// reordering, so anything that must follow a body over time keeps one.
+ids: [*]Id = undefined,
+/// Index of the body behind each ID. The arrays stay dense: removal swaps
+/// the last body in and repoints its ID, so nothing is ever shifted.
+slot_map: SlotMap = .{},
+
+/// Most bodies a store can hold, since indices are `u32`s.
+pub const max_bodies = std.math.maxInt(u32);
+
+const cache_line = 64;
+const field_count = @typeInfo(Field).Enum.fields.len;
+const bodies_per_chunk = 4096;
+/// A reservation has room for this many times the bodies asked for...
+const reserve_headroom = 16;
+/// ...and never for fewer than this.
+const min_reserved = 1 << 16;
+
+/// One contiguous, cache-line aligned array per field, so kernels can stream
+/// through exactly the components they need.
+pub const Field = enum {
+    x,
+    y,
+    vx,
+    vy,
+    ax,
+    ay,
+    /// Time derivative of acceleration, only kept up to date by Hermite.
+    jx,
+    jy,
+    prev_x,
+    prev_y,
+    mass,
+    radius,
+    /// Block timestep level: the body steps by `dt / 2^level`. A small whole
+    /// number, kept as a float so it moves with the other fields.
+    level,
+};
+
+pub const Id = SlotMap.Id;
+
+/// A single body as seen from outside the store, e.g. by the creator tool.
+/// Velocities are in world units per second.
+pub const Body = struct {
+    mass: Real,
+    radius: Real,
+    pos: V2 = .{ 0, 0 },
+    velocity: V2 = .{ 0, 0 },
+};
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{ .allocator = allocator };
+}
+
+pub fn deinit(self: *@This()) void {
+    if (self.memory) |memory| memory.release();
+    self.slot_map.deinit(self.allocator);
+    self.* = init(self.allocator);
+}
+
+pub inline fn items(self: @This(), comptime field: Field) []align(cache_line) Real {
+    return self.arrays[@intFromEnum(field)][0..self.len];
+}
+
+pub fn ensureUnusedCapacity(self: *@This(), count: usize) !void {
+    try self.slot_map.ensureUnusedCapacity(self.allocator, count);
+    const needed = self.len + count;
+    if (needed <= self.capacity) return;
+    if (needed > max_bodies) return error.OutOfMemory;
+
+    if (needed > self.reserved) {
+        try self.reserve(@min(@max(needed *| reserve_headroom, min_reserved), max_bodies));
+    }
+    var new_capacity = @max(self.capacity, 64);
+    while (new_capacity < needed) new_capacity *= 2;
+    new_capacity = @min(new_capacity, self.reserved);
+    const field_bytes = fieldBytes(self.reserved) catch unreachable;
+    try commit(self.memory.?, field_bytes, self.capacity, new_capacity);
+    self.capacity = new_capacity;
+}
+
+/// Moves the bodies into a fresh reservation for `reserved` bodies and
+/// gives back the old one.
+fn reserve(self: *@This(), reserved: usize) !void {
+    const field_bytes = try fieldBytes(reserved);
+    const ids_offset = field_count * field_bytes;
+    const memory = try VirtualMemory.reserve(
+        try std.math.add(usize, ids_offset, try std.math.mul(usize, reserved, @sizeOf(Id))),
+    );
+    errdefer memory.release();
+    try commit(memory, field_bytes, 0, self.len);
+
+    var arrays: [field_count][*]align(cache_line) Real = undefined;
+    for (&arrays, 0..) |*array, field| {
+        array.* = @ptrCast(@alignCast(memory.bytes[field * field_bytes ..].ptr));
+    }
+    const ids: [*]Id = @ptrCast(@alignCast(memory.bytes[ids_offset..].ptr));
+    if (self.memory) |old_memory| {
+        for (arrays, self.arrays) |to, from| @memcpy(to[0..self.len], from[0..self.len]);
+        @memcpy(ids[0..self.len], self.ids[0..self.len]);
+        old_memory.release();
+    }
+
+    self.memory = memory;
+    self.reserved = reserved;
+    self.capacity = self.len;
+    self.arrays = arrays;
+    self.ids = ids;
+}
+
+/// Commits room for bodies `start..end` of every field and the IDs.
+fn commit(memory: VirtualMemory, field_bytes: usize, start: usize, end: usize) !void {
+    for (0..field_count) |field| {
+        try memory.commit(
+            field * field_bytes + start * @sizeOf(Real),
+            field * field_bytes + end * @sizeOf(Real),
+        );
+    }
+    const ids_offset = field_count * field_bytes;
+    try memory.commit(ids_offset + start * @sizeOf(Id), ids_offset + end * @sizeOf(Id));
+}
+
+/// Bytes between the starts of consecutive fields, whole pages so that
+/// every field is cache-line aligned.
+fn fieldBytes(reserved: usize) !usize {
+    const bytes = try std.math.mul(usize, reserved, @sizeOf(Real));
+    return std.mem.alignForward(usize, bytes, std.mem.page_size);
+}
+
+pub fn append(self: *@This(), body: Body) !void {
+    try self.ensureUnusedCapacity(1);
+    self.appendAssumeCapacity(body);
+}
+
+pub fn appendAssumeCapacity(self: *@This(), body: Body) void {
+    std.debug.assert(self.len < self.capacity);
+    self.len += 1;
+    self.assignId(self.len - 1);
+    self.set(self.len - 1, body);
+}
+
+/// Sets the number of bodies. New entries get fresh IDs but are otherwise
+/// undefined.
+pub fn resize(self: *@This(), len: usize) !void {
+    if (len > self.len) try self.ensureUnusedCapacity(len - self.len);
+    for (self.ids[@min(len, self.len)..self.len]) |body_id| self.slot_map.remove(body_id);
+    const old_len = self.len;
+    self.len = len;
+    if (len > old_len) {
+        for (old_len..len) |i| self.assignId(i);
+    }
+}
+
+/// Removes body `i` by moving the last body into its place.
+pub fn swapRemove(self: *@This(), i: usize) void {
+    const last = self.len - 1;
+    for (self.arrays) |array| array[i] = array[last];
+    self.slot_map.remove(self.ids[i]);
+    if (i != last) {
+        self.ids[i] = self.ids[last];
+        self.slot_map.move(self.ids[i], @intCast(i));
+    }
+    self.len = last;
+}
+
+pub fn clear(self: *@This()) void {
+    for (self.ids[0..self.len]) |body_id| self.slot_map.remove(body_id);
+    self.len = 0;
+}
+
+/// Stable ID of body `i`.
+pub inline fn id(self: @This(), i: usize) Id {
+    return self.ids[i];
+}
+
+/// Current index of the body with ID `body_id`, or null once it is gone.
+pub fn indexOf(self: @This(), body_id: Id) ?usize {
+    return self.slot_map.get(body_id);
+}
+
+/// Moves body `order[k]` to index `k` for every `k`, using `scratch` (at
+/// least `len` long) for one field at a time. IDs move with their bodies.
+pub fn permute(self: @This(), order: []const u32, scratch: []u64, pool: ?*Pool) void {
+    std.debug.assert(order.len == self.len);
+    inline for (std.meta.fields(Field)) |field| {
+        gather(Real, self.items(@field(Field, field.name)), order, scratch, pool);
+    }
+    const ids = self.ids[0..self.len];
+    gather(Id, ids, order, scratch, pool);
+    for (ids, 0..) |body_id, index| self.slot_map.move(body_id, @intCast(index));
+}
+
+/// Replaces `values[k]` with `values[order[k]]` through `scratch`.
+fn gather(
+    comptime T: type,
+    values: []T,
+    order: []const u32,
+    scratch: []u64,
+    pool: ?*Pool,
+) void {
+    comptime std.debug.assert(@sizeOf(T) <= @sizeOf(u64));
+    const Gather = struct {
+        from: []const T,
+        to: []T,
+        order: []const u32,
+
+        fn run(self: @This(), start: usize, end: usize) void {
+            for (self.to[start..end], self.order[start..end]) |*value, i| value.* = self.from[i];
+        }
+    };
+    const to = std.mem.bytesAsSlice(T, std.mem.sliceAsBytes(scratch))[0..values.len];
+    const context = Gather{ .from = values, .to = to, .order = order };
+    if (pool) |p| {
+        p.parallelFor(values.len, bodies_per_chunk, context, Gather.run);
+    } else {
+        context.run(0, values.len);
+    }
+    @memcpy(values, context.to);
+}
+
+fn assignId(self: *@This(), i: usize) void {
+    self.ids[i] = self.slot_map.insertAssumeCapacity(@intCast(i));
+}
+
+pub fn get(self: @This(), i: usize) Body {
+    return .{
+        .mass = self.items(.mass)[i],
+        .radius = self.items(.radius)[i],
+        .pos = .{ self.items(.x)[i], self.items(.y)[i] },
+        .velocity = .{ self.items(.vx)[i], self.items(.vy)[i] },
+    };
+}
+
+/// Overwrites body `i`, resetting its interpolation history, acceleration and
+/// jerk.
+pub fn set(self: @This(), i: usize, body: Body) void {
+    self.items(.mass)[i] = body.mass;
+    self.items(.radius)[i] = body.radius;
+    self.items(.x)[i] = body.pos[0];
+    self.items(.y)[i] = body.pos[1];
+    self.items(.vx)[i] = body.velocity[0];
+    self.items(.vy)[i] = body.velocity[1];
+    self.items(.prev_x)[i] = body.pos[0];
+    self.items(.prev_y)[i] = body.pos[1];
+    self.items(.ax)[i] = 0;
+    self.items(.ay)[i] = 0;
+    self.items(.jx)[i] = 0;
+    self.items(.jy)[i] = 0;
+    self.items(.level)[i] = 0;
+}
+
+fn testBodies(count: usize) !@This() {
+    var bodies = init(std.testing.allocator);
+    errdefer bodies.deinit();
+    for (0..count) |i| try bodies.append(.{ .mass = @floatFromInt(i), .radius = 1 });
+    return bodies;
+}
+
+test "swapRemove keeps the other IDs pointing at their bodies" {
+    var bodies = try testBodies(3);
+    defer bodies.deinit();
+    const ids = [_]Id{ bodies.id(0), bodies.id(1), bodies.id(2) };
+
+    // Removing the last body moves nothing.
+    bodies.swapRemove(2);
+    try std.testing.expectEqual(@as(usize, 2), bodies.len);
+    try std.testing.expectEqual(@as(?usize, null), bodies.indexOf(ids[2]));
+    try std.testing.expectEqual(@as(?usize, 0), bodies.indexOf(ids[0]));
+    try std.testing.expectEqual(@as(?usize, 1), bodies.indexOf(ids[1]));
+
+    bodies.swapRemove(0);
+    try std.testing.expectEqual(@as(?usize, null), bodies.indexOf(ids[0]));
+    try std.testing.expectEqual(@as(?usize, 0), bodies.indexOf(ids[1]));
+    try std.testing.expectEqual(@as(Real, 1), bodies.items(.mass)[0]);
+
+    try bodies.append(.{ .mass = 7, .radius = 1 });
+    try std.testing.expectEqual(@as(?usize, 1), bodies.indexOf(bodies.id(1)));
+    try std.testing.expectEqual(@as(?usize, null), bodies.indexOf(ids[2]));
+}
+
+test "resize gives new bodies IDs and retires the IDs of dropped ones" {
+    var bodies = try testBodies(3);
+    defer bodies.deinit();
+
+    try bodies.resize(6);
+    var ids: [6]Id = undefined;
+    for (&ids, 0..) |*body_id, i| body_id.* = bodies.id(i);
+    for (ids, 0..) |body_id, i| try std.testing.expectEqual(@as(?usize, i), bodies.indexOf(body_id));
+
+    try bodies.resize(2);
+    try std.testing.expectEqual(@as(usize, 2), bodies.len);
+    for (ids[0..2], 0..) |body_id, i| try std.testing.expectEqual(@as(?usize, i), bodies.indexOf(body_id));
+    for (ids[2..]) |body_id| try std.testing.expectEqual(@as(?usize, null), bodies.indexOf(body_id));
+
+    try bodies.resize(0);
+    for (ids) |body_id| try std.testing.expectEqual(@as(?usize, null), bodies.indexOf(body_id));
+}
+
+test "permute moves IDs with their bodies and inverts cleanly" {
+    const n = 100;
+    var bodies = try testBodies(n);
+    defer bodies.deinit();
+    var ids: [n]Id = undefined;
+    for (&ids, 0..) |*body_id, i| body_id.* = bodies.id(i);
+
+    var order: [n]u32 = undefined;
+    for (&order, 0..) |*index, i| index.* = @intCast(i);
+    var prng = std.rand.DefaultPrng.init(3);
+    prng.random().shuffle(u32, &order);
+    var scratch: [n]u64 = undefined;
+
+    bodies.permute(&order, &scratch, null);
+    for (order, 0..) |from, to| {
+        try std.testing.expectEqual(@as(Real, @floatFromInt(from)), bodies.items(.mass)[to]);
+        try std.testing.expectEqual(ids[from], bodies.id(to));
+        try std.testing.expectEqual(@as(?usize, to), bodies.indexOf(ids[from]));
+    }
+
+    var inverse: [n]u32 = undefined;
+    for (order, 0..) |from, to| inverse[from] = @intCast(to);
+    bodies.permute(&inverse, &scratch, null);
+    for (ids, 0..) |body_id, i| {
+        try std.testing.expectEqual(@as(Real, @floatFromInt(i)), bodies.items(.mass)[i]);
+        try std.testing.expectEqual(@as(?usize, i), bodies.indexOf(body_id));
+    }
+}
+
+test "outgrowing the reservation moves bodies and IDs intact" {
+    var bodies = try testBodies(10);
+    defer bodies.deinit();
+    const first_reserved = bodies.reserved;
+    const ids = [_]Id{ bodies.id(0), bodies.id(9) };
+
+    try bodies.ensureUnusedCapacity(first_reserved);
+    try std.testing.expect(bodies.reserved > first_reserved);
+    try std.testing.expectEqual(@as(?usize, 0), bodies.indexOf(ids[0]));
+    try std.testing.expectEqual(@as(?usize, 9), bodies.indexOf(ids[1]));
+    for (bodies.items(.mass), 0..) |mass, i| {
+        try std.testing.expectEqual(@as(Real, @floatFromInt(i)), mass);
+    }
+    try bodies.append(.{ .mass = 10, .radius = 1 });
+    try std.testing.expectEqual(ids[1], bodies.id(9));
+}
@@ -0,0 +1,173 @@
+const SimThread = @import("SimThread.zig");
+const rl = @import("rl.zig");
+const std = @import("std");
+
+shader: c_uint,
+vao: c_uint,
+corners: c_uint,
+buffers: [attributes.len]c_uint = [_]c_uint{0} ** attributes.len,
+capacity: usize = 0,
+locations: Locations,
+
+/// Per-instance attributes, each streamed from the snapshot field of the
+/// same name into its own buffer at location `index + 1`. Location 0 is the
+/// quad corner.
+const attributes = [_][]const u8{ "x", "y", "prev_x", "prev_y", "radius" };
+
+const Locations = struct {
+    screen: c_int,
+    scale: c_int,
+    alpha: c_int,
+    colour: c_int,
+};
+
+/// Two triangles covering [-1, 1]^2; the fragment shader cuts the circle.
+/// Wound so they are counter-clockwise after the shader flips y, since
+/// rlgl culls back faces.
+const quad = [_]f32{ -1, -1, 1, 1, 1, -1, -1, -1, -1, 1, 1, 1 };
+
+const vertex_shader =
+    \\#version 330
+    \\layout(location = 0) in vec2 corner;
+    \\layout(location = 1) in float x;
+    \\layout(location = 2) in float y;
+    \\layout(location = 3) in float prev_x;
+    \\layout(location = 4) in float prev_y;
+    \\layout(location = 5) in float radius;
+    \\uniform vec2 screen;
+    \\uniform float scale;
+    \\uniform float alpha;
+    \\out vec2 local;
+    \\void main() {
+    \\    local = corner;
+    \\    vec2 pos = mix(vec2(prev_x, prev_y), vec2(x, y), alpha);
+    \\    vec2 pixel = (pos + corner * radius) * scale;
+    \\    gl_Position = vec4(
+    \\        pixel.x / screen.x * 2.0 - 1.0,
+    \\        1.0 - pixel.y / screen.y * 2.0,
+    \\        0.0,
+    \\        1.0
+    \\    );
+    \\}
+;
+
+const fragment_shader =
+    \\#version 330
+    \\in vec2 local;
+    \\uniform vec4 colour;
+    \\out vec4 frag_colour;
+    \\void main() {
+    \\    float dist = length(local);
+    \\    float edge = fwidth(dist);
+    \\    float coverage = 1.0 - smoothstep(1.0 - edge, 1.0, dist);
+    \\    if (coverage <= 0.0) discard;
+    \\    frag_colour = vec4(colour.rgb, colour.a * coverage);
+    \\}
+;
+
+/// Compiles the circle shader and sets up the instanced vertex array, or
+/// returns null if the GL context cannot run it.
+pub fn init() ?@This() {
+    const shader = rl.rlLoadShaderCode(vertex_shader, fragment_shader);
+    if (shader == rl.rlGetShaderIdDefault()) return null;
+
+    const vao = rl.rlLoadVertexArray();
+    if (vao == 0) {
+        rl.rlUnloadShaderProgram(shader);
+        return null;
+    }
+
+    _ = rl.rlEnableVertexArray(vao);
+    const corners = rl.rlLoadVertexBuffer(&quad, @sizeOf(@TypeOf(quad)), false);
+    rl.rlSetVertexAttribute(0, 2, rl.RL_FLOAT, false, 0, null);
+    rl.rlEnableVertexAttribute(0);
+    rl.rlDisableVertexArray();
+
+    return .{
+        .shader = shader,
+        .vao = vao,
+        .corners = corners,
+        .locations = .{
+            .screen = rl.rlGetLocationUniform(shader, "screen"),
+            .scale = rl.rlGetLocationUniform(shader, "scale"),
+            .alpha = rl.rlGetLocationUniform(shader, "alpha"),
+            .colour = rl.rlGetLocationUniform(shader, "colour"),
+        },
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    for (self.buffers) |buffer| {
+        if (buffer != 0) rl.rlUnloadVertexBuffer(buffer);
+    }
+    rl.rlUnloadVertexBuffer(self.corners);
+    rl.rlUnloadVertexArray(self.vao);
+    rl.rlUnloadShaderProgram(self.shader);
+}
+
+/// Uploads every body of `snapshot` and draws them all in one instanced call.
+pub fn draw(
+    self: *@This(),
+    snapshot: *const SimThread.Snapshot,
+    alpha: f32,
+    width: c_int,
+    height: c_int,
+    colour: rl.Color,
+) void {
+    const count = snapshot.len();
+    if (count == 0) return;
+    self.reserve(count);
+
+    inline for (attributes, 0..) |name, i| {
+        const values = @field(snapshot, name).items;
+        rl.rlUpdateVertexBuffer(
+            self.buffers[i],
+            values.ptr,
+            @intCast(values.len * @sizeOf(f32)),
+            0,
+        );
+    }
+
+    // Anything raylib has batched so far must land underneath the bodies.
+    rl.rlDrawRenderBatchActive();
+
+    const screen = [2]f32{ @floatFromInt(width), @floatFromInt(height) };
+    const scale: f32 = @floatFromInt(height);
+    const colour_normal = [4]f32{
+        @as(f32, @floatFromInt(colour.r)) / 255,
+        @as(f32, @floatFromInt(colour.g)) / 255,
+        @as(f32, @floatFromInt(colour.b)) / 255,
+        @as(f32, @floatFromInt(colour.a)) / 255,
+    };
+
+    rl.rlEnableShader(self.shader);
+    rl.rlSetUniform(self.locations.screen, &screen, rl.RL_SHADER_UNIFORM_VEC2, 1);
+    rl.rlSetUniform(self.locations.scale, &scale, rl.RL_SHADER_UNIFORM_FLOAT, 1);
+    rl.rlSetUniform(self.locations.alpha, &alpha, rl.RL_SHADER_UNIFORM_FLOAT, 1);
+    rl.rlSetUniform(self.locations.colour, &colour_normal, rl.RL_SHADER_UNIFORM_VEC4, 1);
+
+    _ = rl.rlEnableVertexArray(self.vao);
+    rl.rlDrawVertexArrayInstanced(0, quad.len / 2, @intCast(count));
+    rl.rlDisableVertexArray();
+    rl.rlDisableShader();
+}
+
+/// Grows the per-instance buffers to hold at least `count` bodies.
+fn reserve(self: *@This(), count: usize) void {
+    if (count <= self.capacity) return;
+
+    var capacity = @max(self.capacity, 1024);
+    while (capacity < count) capacity *= 2;
+
+    _ = rl.rlEnableVertexArray(self.vao);
+    for (&self.buffers, 1..) |*buffer, location| {
+        if (buffer.* != 0) rl.rlUnloadVertexBuffer(buffer.*);
+        buffer.* = rl.rlLoadVertexBuffer(null, @intCast(capacity * @sizeOf(f32)), true);
+        rl.rlSetVertexAttribute(@intCast(location), 1, rl.RL_FLOAT, false, 0, null);
+        rl.rlSetVertexAttributeDivisor(@intCast(location), 1);
+        rl.rlEnableVertexAttribute(@intCast(location));
+    }
+    rl.rlDisableVertexArray();
+
+    self.capacity = capacity;
+}
@@ -0,0 +1,549 @@
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const kernel = @import("kernel.zig");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const FastMultipole = @This();
+const Bodies = Sim.Bodies;
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+/// Body indices grouped by leaf, leaves in row-major order.
+indices: std.ArrayList(u32),
+/// First index in `indices` of each leaf, plus one final entry holding the
+/// total, so leaf `l` owns `indices[starts[l]..starts[l + 1]]`.
+starts: std.ArrayList(u32),
+/// Leaf of each body, kept between the counting and scattering passes.
+leaves: std.ArrayList(u32),
+/// Multipole moments `sum m d^k` of every cell about its centre, `terms`
+/// per cell, level by level from the root.
+multipoles: std.ArrayList(f64),
+/// Taylor coefficients of the far-field potential about every cell centre,
+/// laid out like `multipoles`.
+locals: std.ArrayList(f64),
+/// Taylor coefficients of the softened 1/r up to twice the order, at each of
+/// the 7x7 cell offsets an interaction list can hold, per level.
+derivatives: std.ArrayList(f64),
+/// `(-1)^|k| C(k + n, n)` and the index of `k + n` for each pair of terms
+/// `n`, `k` in the multipole-to-local translation.
+m2l_factors: std.ArrayList(f64),
+m2l_terms: std.ArrayList(u32),
+/// `C(i, j)` for `i, j <= 2 * order`.
+binomials: std.ArrayList(f64),
+order: usize = 0,
+/// Levels below the root; the leaves are at this level.
+depth: usize = 0,
+origin: V2 = .{ 0, 0 },
+size: Real = 0,
+softening_sq: f64 = 0,
+
+pub const max_order = 12;
+/// Leaves are added until they hold about this many bodies on average.
+const leaf_bodies = 64;
+const max_depth = 9;
+const cells_per_chunk = 16;
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{
+        .indices = std.ArrayList(u32).init(allocator),
+        .starts = std.ArrayList(u32).init(allocator),
+        .leaves = std.ArrayList(u32).init(allocator),
+        .multipoles = std.ArrayList(f64).init(allocator),
+        .locals = std.ArrayList(f64).init(allocator),
+        .derivatives = std.ArrayList(f64).init(allocator),
+        .m2l_factors = std.ArrayList(f64).init(allocator),
+        .m2l_terms = std.ArrayList(u32).init(allocator),
+        .binomials = std.ArrayList(f64).init(allocator),
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    self.indices.deinit();
+    self.starts.deinit();
+    self.leaves.deinit();
+    self.multipoles.deinit();
+    self.locals.deinit();
+    self.derivatives.deinit();
+    self.m2l_factors.deinit();
+    self.m2l_terms.deinit();
+    self.binomials.deinit();
+}
+
+/// Builds the far-field expansions of `bodies` on a uniform quadtree, with
+/// Cartesian Taylor expansions of the given order.
+///
+/// The force law is the softened 1/r^2 of the other solvers, whose 1/r
+/// potential is not harmonic in the plane, so the complex-variable
+/// expansions of the 2D log kernel do not apply.
+pub fn solve(
+    self: *@This(),
+    bodies: Bodies,
+    order: usize,
+    softening: Real,
+    pool: ?*Pool,
+) !void {
+    std.debug.assert(order >= 1 and order <= max_order);
+    if (order != self.order) try self.prepare(order);
+    self.softening_sq = @as(f64, softening) * softening;
+    if (bodies.len == 0) return;
+
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    var min = V2{ x[0], y[0] };
+    var max = min;
+    for (x[1..], y[1..]) |body_x, body_y| {
+        min = @min(min, V2{ body_x, body_y });
+        max = @max(max, V2{ body_x, body_y });
+    }
+    const extent = max - min;
+    self.size = @max(extent[0], extent[1], 1e-6) * 1.001;
+    self.origin = min;
+
+    self.depth = 0;
+    while (self.depth < max_depth and
+        std.math.pow(usize, 4, self.depth) * leaf_bodies < bodies.len) self.depth += 1;
+
+    const terms = termCount(order);
+    const cell_count = levelStart(self.depth + 1);
+    try self.multipoles.resize(cell_count * terms);
+    try self.locals.resize(cell_count * terms);
+    try self.derivatives.resize((self.depth + 1) * 49 * termCount(2 * order));
+    @memset(self.multipoles.items, 0);
+    @memset(self.locals.items, 0);
+
+    try self.sortIntoLeaves(x, y);
+    self.computeDerivatives();
+    self.particlesToMultipoles(x, y, bodies.items(.mass));
+    var level = self.depth;
+    while (level > 0) : (level -= 1) self.multipolesToParent(level);
+
+    // Above level 2 every cell neighbours every other, so shallow trees are
+    // all near field and have no far field to expand.
+    if (self.depth < 2) return;
+    for (2..self.depth + 1) |l| {
+        const width = @as(usize, 1) << @intCast(l);
+        const pass = M2L{ .fmm = self, .level = l };
+        if (pool) |p| {
+            p.parallelFor(width * width, cells_per_chunk, pass, M2L.run);
+        } else {
+            pass.run(0, width * width);
+        }
+    }
+    for (2..self.depth) |l| self.localsToChildren(l);
+}
+
+/// Acceleration of body `i` per unit `g`: the far field from its leaf's
+/// local expansion plus a direct sum over its own and adjacent leaves.
+pub fn accel(self: *const @This(), sources: kernel.Sources, i: usize) V2 {
+    const width = @as(usize, 1) << @intCast(self.depth);
+    const leaf = self.leaves.items[i];
+    const ix = leaf % width;
+    const iy = leaf / width;
+
+    const leaf_center = self.center(self.depth, ix, iy);
+    const dx = @as(f64, sources.x[i]) - leaf_center[0];
+    const dy = @as(f64, sources.y[i]) - leaf_center[1];
+    const terms = termCount(self.order);
+    const local = self.locals.items[levelStart(self.depth) * terms + leaf * terms ..][0..terms];
+
+    var pow_x: [max_order + 1]f64 = undefined;
+    var pow_y: [max_order + 1]f64 = undefined;
+    powers(&pow_x, dx, self.order);
+    powers(&pow_y, dy, self.order);
+    var far = [2]f64{ 0, 0 };
+    for (1..self.order + 1) |t| {
+        for (0..t + 1) |b| {
+            const a = t - b;
+            const coefficient = local[term(a, b)];
+            if (a > 0) far[0] += coefficient * @as(f64, @floatFromInt(a)) * pow_x[a - 1] * pow_y[b];
+            if (b > 0) far[1] += coefficient * @as(f64, @floatFromInt(b)) * pow_x[a] * pow_y[b - 1];
+        }
+    }
+
+    var near = kernel.F2{ 0, 0 };
+    for (@max(iy, 1) - 1..@min(iy + 2, width)) |ny| {
+        for (@max(ix, 1) - 1..@min(ix + 2, width)) |nx| {
+            const other = ny * width + nx;
+            const starts = self.starts.items;
+            for (self.indices.items[starts[other]..starts[other + 1]]) |j| {
+                near += kernel.pairAccel(sources, i, j);
+            }
+        }
+    }
+    return precision.cast(V2, @as(@Vector(2, f64), far)) + precision.cast(V2, near);
+}
+
+/// Sizes the order-dependent tables.
+fn prepare(self: *@This(), order: usize) !void {
+    self.order = order;
+    const span = 2 * order + 1;
+    try self.binomials.resize(span * span);
+    const binomials = self.binomials.items;
+    @memset(binomials, 0);
+    for (0..span) |i| {
+        binomials[i * span] = 1;
+        for (1..i + 1) |j| {
+            const above: f64 = if (j < i) binomials[(i - 1) * span + j] else 0;
+            binomials[i * span + j] = binomials[(i - 1) * span + j - 1] + above;
+        }
+    }
+
+    const terms = termCount(order);
+    try self.m2l_factors.resize(terms * terms);
+    try self.m2l_terms.resize(terms * terms);
+    for (0..order + 1) |n_total| {
+        for (0..n_total + 1) |n_b| {
+            const n_a = n_total - n_b;
+            const n = term(n_a, n_b);
+            for (0..order + 1) |k_total| {
+                for (0..k_total + 1) |k_b| {
+                    const k_a = k_total - k_b;
+                    const k = term(k_a, k_b);
+                    const sign: f64 = if (k_total % 2 == 0) 1 else -1;
+                    self.m2l_factors.items[n * terms + k] = sign *
+                        self.binomial(k_a + n_a, n_a) * self.binomial(k_b + n_b, n_b);
+                    self.m2l_terms.items[n * terms + k] = @intCast(term(k_a + n_a, k_b + n_b));
+                }
+            }
+        }
+    }
+}
+
+/// Counting-sorts the bodies by leaf.
+fn sortIntoLeaves(self: *@This(), x: []const Real, y: []const Real) !void {
+    const width = @as(usize, 1) << @intCast(self.depth);
+    const leaf_count = width * width;
+    try self.starts.resize(leaf_count + 1);
+    try self.indices.resize(x.len);
+    try self.leaves.resize(x.len);
+    const starts = self.starts.items;
+
+    const scale = @as(Real, @floatFromInt(width)) / self.size;
+    const last: Real = @floatFromInt(width - 1);
+    @memset(starts, 0);
+    for (x, y, self.leaves.items) |px, py, *leaf| {
+        const ix: usize = @intFromFloat(std.math.clamp((px - self.origin[0]) * scale, 0, last));
+        const iy: usize = @intFromFloat(std.math.clamp((py - self.origin[1]) * scale, 0, last));
+        leaf.* = @intCast(iy * width + ix);
+        starts[leaf.*] += 1;
+    }
+    for (1..leaf_count) |l| starts[l] += starts[l - 1];
+
+    var i = x.len;
+    while (i > 0) {
+        i -= 1;
+        const leaf = self.leaves.items[i];
+        starts[leaf] -= 1;
+        self.indices.items[starts[leaf]] = @intCast(i);
+    }
+    starts[leaf_count] = @intCast(x.len);
+}
+
+/// Fills `derivatives` for the offsets of every level's interaction lists.
+fn computeDerivatives(self: *@This()) void {
+    const terms = termCount(2 * self.order);
+    for (0..self.depth + 1) |level| {
+        const cell_size = self.cellSize(level);
+        for (0..7) |oy| {
+            for (0..7) |ox| {
+                const offset = (level * 49 + oy * 7 + ox) * terms;
+                taylor(
+                    self.derivatives.items[offset..][0..terms],
+                    (@as(f64, @floatFromInt(ox)) - 3) * cell_size,
+                    (@as(f64, @floatFromInt(oy)) - 3) * cell_size,
+                    self.softening_sq,
+                    2 * self.order,
+                );
+            }
+        }
+    }
+}
+
+fn particlesToMultipoles(self: *@This(), x: []const Real, y: []const Real, mass: []const Real) void {
+    const width = @as(usize, 1) << @intCast(self.depth);
+    const terms = termCount(self.order);
+    const base = levelStart(self.depth) * terms;
+    var pow_x: [max_order + 1]f64 = undefined;
+    var pow_y: [max_order + 1]f64 = undefined;
+    for (0..width * width) |leaf| {
+        const leaf_center = self.center(self.depth, leaf % width, leaf / width);
+        const moments = self.multipoles.items[base + leaf * terms ..][0..terms];
+        for (self.indices.items[self.starts.items[leaf]..self.starts.items[leaf + 1]]) |i| {
+            powers(&pow_x, @as(f64, x[i]) - leaf_center[0], self.order);
+            powers(&pow_y, @as(f64, y[i]) - leaf_center[1], self.order);
+            for (0..self.order + 1) |t| {
+                for (0..t + 1) |b| {
+                    moments[term(t - b, b)] += @as(f64, mass[i]) * pow_x[t - b] * pow_y[b];
+                }
+            }
+        }
+    }
+}
+
+/// Shifts the moments of every cell at `level` to its parent's centre and
+/// adds them there.
+fn multipolesToParent(self: *@This(), level: usize) void {
+    const width = @as(usize, 1) << @intCast(level);
+    const terms = termCount(self.order);
+    const half = self.cellSize(level) / 2;
+    var pow_x: [max_order + 1]f64 = undefined;
+    var pow_y: [max_order + 1]f64 = undefined;
+    for (0..width * width) |cell| {
+        const ix = cell % width;
+        const iy = cell / width;
+        const child = self.multipoles.items[(levelStart(level) + cell) * terms ..][0..terms];
+        if (child[0] == 0) continue;
+        const parent_cell = (iy / 2) * (width / 2) + ix / 2;
+        const parent = self.multipoles.items[(levelStart(level - 1) + parent_cell) * terms ..][0..terms];
+
+        // Child centre minus parent centre.
+        powers(&pow_x, if (ix % 2 == 0) -half else half, self.order);
+        powers(&pow_y, if (iy % 2 == 0) -half else half, self.order);
+        for (0..self.order + 1) |t| {
+            for (0..t + 1) |b| {
+                const a = t - b;
+                var sum: f64 = 0;
+                for (0..a + 1) |ja| {
+                    for (0..b + 1) |jb| {
+                        sum += self.binomial(a, ja) * self.binomial(b, jb) *
+                            child[term(ja, jb)] * pow_x[a - ja] * pow_y[b - jb];
+                    }
+                }
+                parent[term(a, b)] += sum;
+            }
+        }
+    }
+}
+
+/// Adds each cell's interaction list, the children of its parent's
+/// neighbours that are not its own neighbours, to its local expansion.
+const M2L = struct {
+    fmm: *const FastMultipole,
+    level: usize,
+
+    fn run(self: M2L, start: usize, end: usize) void {
+        const fmm = self.fmm;
+        const width = @as(usize, 1) << @intCast(self.level);
+        const terms = termCount(fmm.order);
+        const derivative_terms = termCount(2 * fmm.order);
+        const base = levelStart(self.level) * terms;
+        for (start..end) |cell| {
+            const ix = cell % width;
+            const iy = cell / width;
+            const local = fmm.locals.items[base + cell * terms ..][0..terms];
+
+            const min_x = (@max(ix / 2, 1) - 1) * 2;
+            const min_y = (@max(iy / 2, 1) - 1) * 2;
+            const max_x = @min(ix / 2 + 2, width / 2) * 2;
+            const max_y = @min(iy / 2 + 2, width / 2) * 2;
+            for (min_y..max_y) |sy| {
+                for (min_x..max_x) |sx| {
+                    if (absDiff(sx, ix) <= 1 and absDiff(sy, iy) <= 1) continue;
+                    const moments = fmm.multipoles.items[base + (sy * width + sx) * terms ..][0..terms];
+                    if (moments[0] == 0) continue;
+
+                    // Derivatives at the target centre minus the source centre.
+                    const offset = self.level * 49 + (iy + 3 - sy) * 7 + (ix + 3 - sx);
+                    const derivatives = fmm.derivatives.items[offset * derivative_terms ..][0..derivative_terms];
+                    for (local, 0..) |*coefficient, n| {
+                        const factors = fmm.m2l_factors.items[n * terms ..][0..terms];
+                        const indices = fmm.m2l_terms.items[n * terms ..][0..terms];
+                        var sum: f64 = 0;
+                        for (moments, factors, indices) |moment, factor, index| {
+                            sum += factor * moment * derivatives[index];
+                        }
+                        coefficient.* += sum;
+                    }
+                }
+            }
+        }
+    }
+};
+
+/// Shifts the local expansion of every cell at `level` to each of its
+/// children's centres and adds it there.
+fn localsToChildren(self: *@This(), level: usize) void {
+    const width = @as(usize, 1) << @intCast(level);
+    const terms = termCount(self.order);
+    const quarter = self.cellSize(level) / 4;
+    var pow_x: [max_order + 1]f64 = undefined;
+    var pow_y: [max_order + 1]f64 = undefined;
+    for (0..width * width) |cell| {
+        const ix = cell % width;
+        const iy = cell / width;
+        const parent = self.locals.items[(levelStart(level) + cell) * terms ..][0..terms];
+        for (0..4) |quadrant| {
+            const cx = ix * 2 + quadrant % 2;
+            const cy = iy * 2 + quadrant / 2;
+            const child_cell = cy * width * 2 + cx;
+            const child = self.locals.items[(levelStart(level + 1) + child_cell) * terms ..][0..terms];
+
+            powers(&pow_x, if (quadrant % 2 == 0) -quarter else quarter, self.order);
+            powers(&pow_y, if (quadrant / 2 == 0) -quarter else quarter, self.order);
+            for (0..self.order + 1) |t| {
+                for (0..t + 1) |b| {
+                    const a = t - b;
+                    var sum: f64 = 0;
+                    for (t..self.order + 1) |mt| {
+                        for (0..mt + 1) |mb| {
+                            const ma = mt - mb;
+                            if (ma < a or mb < b) continue;
+                            sum += parent[term(ma, mb)] * self.binomial(ma, a) *
+                                self.binomial(mb, b) * pow_x[ma - a] * pow_y[mb - b];
+                        }
+                    }
+                    child[term(a, b)] += sum;
+                }
+            }
+        }
+    }
+}
+
+/// Taylor coefficients `D^k f / k!` of `f = 1 / sqrt(x^2 + y^2 + s^2)` at
+/// (x, y) for every `|k| <= order`, by the recurrence of Duan and Krasny.
+fn taylor(out: []f64, x: f64, y: f64, softening_sq: f64, order: usize) void {
+    const r_sq = x * x + y * y + softening_sq;
+    out[0] = 1 / @sqrt(r_sq);
+    for (1..order + 1) |t| {
+        const t_f: f64 = @floatFromInt(t);
+        for (0..t + 1) |b| {
+            const a = t - b;
+            var first: f64 = 0;
+            var second: f64 = 0;
+            if (a >= 1) first += x * out[term(a - 1, b)];
+            if (b >= 1) first += y * out[term(a, b - 1)];
+            if (a >= 2) second += out[term(a - 2, b)];
+            if (b >= 2) second += out[term(a, b - 2)];
+            out[term(a, b)] = -((2 * t_f - 1) * first + (t_f - 1) * second) / (t_f * r_sq);
+        }
+    }
+}
+
+fn powers(out: *[max_order + 1]f64, value: f64, order: usize) void {
+    out[0] = 1;
+    for (1..order + 1) |i| out[i] = out[i - 1] * value;
+}
+
+inline fn binomial(self: *const @This(), n: usize, k: usize) f64 {
+    return self.binomials.items[n * (2 * self.order + 1) + k];
+}
+
+fn center(self: *const @This(), level: usize, ix: usize, iy: usize) [2]f64 {
+    const cell_size = self.cellSize(level);
+    return .{
+        self.origin[0] + (@as(f64, @floatFromInt(ix)) + 0.5) * cell_size,
+        self.origin[1] + (@as(f64, @floatFromInt(iy)) + 0.5) * cell_size,
+    };
+}
+
+fn cellSize(self: *const @This(), level: usize) f64 {
+    return @as(f64, self.size) / @as(f64, @floatFromInt(@as(usize, 1) << @intCast(level)));
+}
+
+inline fn absDiff(a: usize, b: usize) usize {
+    return if (a > b) a - b else b - a;
+}
+
+/// Number of terms `(a, b)` with `a + b <= order`.
+inline fn termCount(order: usize) usize {
+    return (order + 1) * (order + 2) / 2;
+}
+
+/// Index of term `(a, b)`, grouped by total degree.
+inline fn term(a: usize, b: usize) usize {
+    const t = a + b;
+    return t * (t + 1) / 2 + b;
+}
+
+/// Index of the first cell of `level` when levels are stored root first.
+inline fn levelStart(level: usize) usize {
+    return ((@as(usize, 1) << @intCast(2 * level)) - 1) / 3;
+}
+
+test "accel converges on the direct sum as the order grows" {
+    const allocator = std.testing.allocator;
+    const softening = 1e-3;
+
+    var bodies = Bodies.init(allocator);
+    defer bodies.deinit();
+    var prng = std.rand.DefaultPrng.init(0);
+    const random = prng.random();
+    for (0..2000) |_| {
+        try bodies.append(.{
+            .mass = 1e-3 + random.float(Real),
+            .radius = 1e-3,
+            .pos = .{ random.float(Real), random.float(Real) },
+        });
+    }
+    const sources = kernel.Sources{
+        .x = bodies.items(.x),
+        .y = bodies.items(.y),
+        .mass = bodies.items(.mass),
+        .softening_sq = softening * softening,
+    };
+
+    const exact = try allocator.alloc(V2, bodies.len);
+    defer allocator.free(exact);
+    var sum_sq: f64 = 0;
+    for (exact, 0..) |*a, i| {
+        a.* = kernel.accelScalar(sources, i);
+        sum_sq += @as(f64, a[0]) * a[0] + @as(f64, a[1]) * a[1];
+    }
+    const rms = @sqrt(sum_sq / @as(f64, @floatFromInt(bodies.len)));
+
+    var fmm = init(allocator);
+    defer fmm.deinit();
+    var last_err = std.math.inf(f64);
+    for ([_]usize{ 2, 4, 6 }) |order| {
+        try fmm.solve(bodies, order, softening, null);
+        // Relative to the typical force, since single forces can cancel to
+        // almost nothing.
+        var max_err: f64 = 0;
+        for (exact, 0..) |a, i| {
+            const diff = fmm.accel(sources, i) - a;
+            const err = @sqrt(@as(f64, diff[0]) * diff[0] + @as(f64, diff[1]) * diff[1]);
+            max_err = @max(max_err, err / rms);
+        }
+        try std.testing.expect(max_err < last_err);
+        last_err = max_err;
+    }
+    try std.testing.expect(last_err < 1e-3);
+}
+
+test "accel is the direct sum for trees too shallow for a far field" {
+    const allocator = std.testing.allocator;
+    const softening = 1e-3;
+
+    var fmm = init(allocator);
+    defer fmm.deinit();
+    var prng = std.rand.DefaultPrng.init(1);
+    const random = prng.random();
+    // One leaf, then four: depths 0 and 1.
+    for ([_]usize{ 1, 30, 100 }) |count| {
+        var bodies = Bodies.init(allocator);
+        defer bodies.deinit();
+        for (0..count) |_| {
+            try bodies.append(.{
+                .mass = 1e-3 + random.float(Real),
+                .radius = 1e-3,
+                .pos = .{ random.float(Real), random.float(Real) },
+            });
+        }
+        const sources = kernel.Sources{
+            .x = bodies.items(.x),
+            .y = bodies.items(.y),
+            .mass = bodies.items(.mass),
+            .softening_sq = softening * softening,
+        };
+
+        try fmm.solve(bodies, 4, softening, null);
+        try std.testing.expect(fmm.depth < 2);
+        for (0..count) |i| {
+            const exact = kernel.accelScalar(sources, i);
+            const diff = fmm.accel(sources, i) - exact;
+            const scale = @max(@sqrt(@reduce(.Add, exact * exact)), 1e-12);
+            try std.testing.expect(@sqrt(@reduce(.Add, diff * diff)) <= 1e-4 * scale + 1e-12);
+        }
+    }
+}
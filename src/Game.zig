@@ -1,10 +1,12 @@
-const rl = @cImport({
-    @cInclude("raylib.h");
-    @cInclude("raymath.h");
-});
+const BodyRenderer = @import("BodyRenderer.zig");
+const rl = @import("rl.zig");
+const Sim = @import("Sim.zig");
+const SimThread = @import("SimThread.zig");
+const precision = @import("precision.zig");
 const std = @import("std");
 
-const pow = std.math.pow;
+const Body = Sim.Body;
+/// Screen-side vector. The simulation's own may be wider.
 const V2 = @Vector(2, f32);
 
 allocator: std.mem.Allocator,
@@ -12,33 +14,40 @@ name: []const u8,
 width: c_int,
 height: c_int,
 fps: c_int = default_fps,
-g: f32 = 3e-8 / @as(f32, default_fps),
-delta: f32 = 0,
 cursor_radius: f32 = 0,
-bodies: std.ArrayList(Body) = undefined,
+sim: *SimThread,
+save_path: []const u8,
+bounds: V2 = .{ 0, 0 },
+body_renderer: ?BodyRenderer = null,
 creator: Creator = undefined,
 mouse_pos: V2 = .{ 0, 0 },
 
 const default_fps = 60;
-const collision_dampen_factor = 0.3;
-
-const Body = struct {
-    mass: f32,
-    radius: f32,
-    pos: V2 = .{ 0, 0 },
-    velocity: V2 = .{ 0, 0 },
-};
+const selection_ring_thickness = 0.004;
 
 const Creator = struct {
     active: bool = false,
     displacement: V2 = .{ 0, 0 },
-    body: Body,
+    pos: V2 = .{ 0, 0 },
+    radius: f32 = 0,
 
     pub const colour_inactive = Colour.blue;
     pub const colour_active = Colour.grey_dark;
     pub const colour_line = colour_active;
     pub const ring_thickness = 0.004;
     pub const line_width = 0.004;
+    /// Launch velocity per unit of drag, in world units per second.
+    pub const launch_speed = 0.6;
+
+    /// The body the creator would place, launched at `velocity`.
+    fn body(self: @This(), velocity: V2) Body {
+        return .{
+            .mass = Sim.massFromRadius(self.radius),
+            .radius = self.radius,
+            .pos = precision.cast(Sim.V2, self.pos),
+            .velocity = precision.cast(Sim.V2, velocity),
+        };
+    }
 };
 
 const Colour = struct {
@@ -55,9 +64,11 @@ const Colour = struct {
     pub const black = fromHex(0x000000);
     pub const grey_light = fromHex(0xc0c0c0);
     pub const grey_dark = fromHex(0x555555);
+    pub const red = fromHex(0x8b0000);
 
     pub const background = grey_light;
     pub const body = black;
+    pub const selection = red;
 };
 
 pub fn init(game: @This()) @This() {
@@ -66,11 +77,16 @@ pub fn init(game: @This()) @This() {
     rl.InitWindow(game.width, game.height, @ptrCast(game.name));
 
     var result = game;
-    result.bodies = std.ArrayList(Body).init(result.allocator);
+    result.body_renderer = BodyRenderer.init();
+    if (result.body_renderer == null) {
+        std.log.warn("instanced rendering unavailable, drawing bodies one by one", .{});
+    }
     return result;
 }
 
-pub fn deinit(_: *@This()) void {
+pub fn deinit(self: *@This()) void {
+    self.sim.destroy();
+    if (self.body_renderer) |*renderer| renderer.deinit();
     rl.CloseWindow();
 }
 
@@ -87,11 +103,16 @@ pub fn frameEnd(_: *@This()) void {
     rl.EndDrawing();
 }
 
-pub fn updateAndRender(self: *@This()) !void {
-    self.delta = rl.GetFrameTime();
+pub fn update(self: *@This()) void {
     self.width = rl.GetScreenWidth();
     self.height = rl.GetScreenHeight();
 
+    const bounds = V2{ self.normalWidth(), 1 };
+    if (@reduce(.Or, bounds != self.bounds)) {
+        self.bounds = bounds;
+        self.sim.send(.{ .bounds = precision.cast(Sim.V2, bounds) });
+    }
+
     self.mouse_pos = self.normalFromScreen(
         v2fromRaylib(rl.GetMousePosition()),
     );
@@ -99,96 +120,82 @@ pub fn updateAndRender(self: *@This()) !void {
     self.cursor_radius = std.math.clamp(self.cursor_radius, 0.01, 0.1);
 
     const creator = &self.creator;
-    creator.body.mass = std.math.pow(f32, self.cursor_radius * 1000, 3);
-    creator.body.radius = self.cursor_radius;
+    creator.radius = self.cursor_radius;
 
-    if (rl.IsKeyPressed('R')) self.bodies.shrinkRetainingCapacity(0);
+    if (rl.IsKeyPressed('R')) self.sim.send(.clear);
+    if (rl.IsMouseButtonPressed(rl.MOUSE_BUTTON_MIDDLE)) {
+        self.sim.send(.{ .select = precision.cast(Sim.V2, self.mouse_pos) });
+    }
+    if (rl.IsKeyPressed('S')) self.sim.send(.{ .save = self.save_path });
+    if (rl.IsKeyPressed('L')) {
+        self.sim.send(.{ .load = self.save_path });
+        // The save state brings its own bounds; resend the window's.
+        self.bounds = .{ 0, 0 };
+    }
 
     if (creator.active) {
         if (rl.IsMouseButtonDown(rl.MOUSE_BUTTON_RIGHT)) {
-            creator.displacement = self.mouse_pos - creator.body.pos;
+            creator.displacement = self.mouse_pos - creator.pos;
         } else if (rl.IsMouseButtonReleased(rl.MOUSE_BUTTON_RIGHT)) {
             creator.active = false;
         }
 
         if (rl.IsMouseButtonPressed(rl.MOUSE_BUTTON_LEFT)) {
-            const factor: V2 = @splat(100);
-            creator.body.velocity = creator.displacement / factor;
-            try self.bodies.append(creator.body);
+            const factor: V2 = @splat(Creator.launch_speed);
+            self.sim.send(.{ .add = creator.body(creator.displacement * factor) });
         }
     } else {
         if (rl.IsMouseButtonPressed(rl.MOUSE_BUTTON_RIGHT)) {
             creator.active = true;
             creator.displacement = .{ 0, 0 };
-            creator.body.pos = self.mouse_pos;
+            creator.pos = self.mouse_pos;
         } else if (rl.IsMouseButtonPressed(rl.MOUSE_BUTTON_LEFT)) {
-            creator.body.pos = self.mouse_pos;
-            creator.body.velocity = .{ 0, 0 };
-            try self.bodies.append(creator.body);
+            creator.pos = self.mouse_pos;
+            self.sim.send(.{ .add = creator.body(.{ 0, 0 }) });
         }
     }
+}
 
-    for (0..self.bodies.items.len) |i| {
-        for (i + 1..self.bodies.items.len) |cmp_i| {
-            self.computeInteraction(i, cmp_i);
-        }
-        self.computeScreenCollision(i);
-
-        const body = &self.bodies.items[i];
+pub fn render(self: *@This()) void {
+    const snapshot = self.sim.latest();
+    const alpha = self.sim.alpha(snapshot);
 
-        body.pos += body.velocity;
-        const pos = self.screenFromNormal(body.pos);
-        rl.DrawCircleV(
-            raylibFromV2(pos),
-            self.screenFromNormal(body.radius),
-            Colour.black,
-        );
+    if (self.body_renderer) |*renderer| {
+        renderer.draw(snapshot, alpha, self.width, self.height, Colour.body);
+    } else {
+        for (0..snapshot.len()) |i| {
+            const pos = self.screenFromNormal(snapshot.interpolatedPos(i, alpha));
+            rl.DrawCircleV(
+                raylibFromV2(pos),
+                self.screenFromNormal(snapshot.radius.items[i]),
+                Colour.body,
+            );
+        }
     }
 
+    self.renderSelection(snapshot, alpha);
     self.renderCreator();
 }
 
-fn computeInteraction(self: *@This(), i: usize, cmp_i: usize) void {
-    const body = &self.bodies.items[i];
-    const body_cmp = &self.bodies.items[cmp_i];
-
-    const dist_xy = body.pos - body_cmp.pos;
-    const dist = @sqrt(pow(f32, dist_xy[0], 2) + pow(f32, dist_xy[1], 2));
-
-    const colliding = dist < (body.radius + body_cmp.radius) / 2;
-    if (colliding) return;
-
-    const force = -1 * self.delta * self.g *
-        body.mass * body_cmp.mass / pow(f32, dist, 2);
-    const force_xy = V2{
-        force * (dist_xy[0] / dist),
-        force * (dist_xy[1] / dist),
-    };
-
-    const body_accel = force_xy / @as(V2, @splat(body.mass));
-    body.velocity += body_accel;
-
-    const body_cmp_accel = force_xy / @as(V2, @splat(body_cmp.mass));
-    body_cmp.velocity -= body_cmp_accel;
-}
-
-fn computeScreenCollision(self: *@This(), i: usize) void {
-    const body = &self.bodies.items[i];
-    const dimensions = [2]f32{ self.normalWidth(), 1 };
-    inline for (0..2) |axis| {
-        if (body.pos[axis] - body.radius < 0) {
-            body.pos[axis] = body.radius;
-            body.velocity[axis] *= -collision_dampen_factor;
-        } else if (body.pos[axis] + body.radius > dimensions[axis]) {
-            body.pos[axis] = dimensions[axis] - body.radius;
-            body.velocity[axis] *= -collision_dampen_factor;
-        }
-    }
+fn renderSelection(self: @This(), snapshot: *const SimThread.Snapshot, alpha: f32) void {
+    const i = snapshot.selected orelse return;
+    const pos = self.screenFromNormal(snapshot.interpolatedPos(i, alpha));
+    const inner_radius = self.screenFromNormal(snapshot.radius.items[i]);
+    const outer_radius = inner_radius +
+        self.screenFromNormal(@as(f32, selection_ring_thickness));
+    rl.DrawRing(
+        raylibFromV2(pos),
+        inner_radius,
+        outer_radius,
+        0,
+        360,
+        0,
+        Colour.selection,
+    );
 }
 
 fn renderCreator(self: @This()) void {
     const creator = self.creator;
-    const body = creator.body;
 
     const inner_radius = self.screenFromNormal(self.cursor_radius);
     const outer_radius = inner_radius +
@@ -207,8 +214,8 @@ fn renderCreator(self: @This()) void {
         return;
     }
 
-    const line_start = self.screenFromNormal(body.pos);
-    const line_end = self.screenFromNormal(body.pos + creator.displacement);
+    const line_start = self.screenFromNormal(creator.pos);
+    const line_end = self.screenFromNormal(creator.pos + creator.displacement);
     const line_width = self.screenFromNormal(@as(f32, Creator.line_width));
     rl.DrawLineEx(
         raylibFromV2(line_start),
@@ -217,7 +224,7 @@ fn renderCreator(self: @This()) void {
         Creator.colour_line,
     );
 
-    const radius = self.screenFromNormal(body.radius);
+    const radius = self.screenFromNormal(creator.radius);
     rl.DrawCircleV(
         raylibFromV2(line_start),
         radius,
@@ -0,0 +1,289 @@
+const Sim = @import("Sim.zig");
+const fft = @import("fft.zig");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const Bodies = Sim.Bodies;
+const Complex = fft.Complex;
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+/// Masses deposited on the mesh, zero-padded to twice `size` per side so the
+/// periodic transform gives isolated rather than periodic gravity. Holds the
+/// potential per unit `g` once `solve` has run.
+work: std.ArrayList(Complex),
+/// Transform of the softened Green's function on the padded mesh.
+green: std.ArrayList(Complex),
+twiddles: std.ArrayList(Complex),
+column: std.ArrayList(Complex),
+/// Acceleration per unit `g` at each node, row-major.
+ax: std.ArrayList(Real),
+ay: std.ArrayList(Real),
+/// Nodes along each side of the mesh.
+size: usize = 0,
+cell_size: Real = 0,
+/// Softening `green` was built with.
+softening: Real = 0,
+/// Radius of the Gaussian splitting `green` into its long-range part, or
+/// zero when it holds the whole force.
+split: Real = 0,
+
+/// Which part of the force the mesh carries.
+pub const Range = enum {
+    /// Everything, softened to at least a cell.
+    full,
+    /// Only the long-range part of an Ewald-style split, `erf(r / split) / r`,
+    /// leaving the rest to a direct sum out to `cutoff`.
+    long,
+};
+
+/// Split radius in cells. Below about a cell the mesh cannot carry the
+/// long-range part faithfully.
+const split_cells = 1.25;
+/// Cutoff of the short-range part in split radii. The short-range force has
+/// fallen to about erfc(4.5), 2e-10, of the full force there.
+const cutoff_splits = 4.5;
+
+/// A body's cloud-in-cell footprint: the node below and left of it and its
+/// fractional offset from that node.
+const Cell = struct {
+    x: usize,
+    y: usize,
+    tx: Real,
+    ty: Real,
+};
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{
+        .work = std.ArrayList(Complex).init(allocator),
+        .green = std.ArrayList(Complex).init(allocator),
+        .twiddles = std.ArrayList(Complex).init(allocator),
+        .column = std.ArrayList(Complex).init(allocator),
+        .ax = std.ArrayList(Real).init(allocator),
+        .ay = std.ArrayList(Real).init(allocator),
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    self.work.deinit();
+    self.green.deinit();
+    self.twiddles.deinit();
+    self.column.deinit();
+    self.ax.deinit();
+    self.ay.deinit();
+}
+
+/// Computes the acceleration field of `bodies` on a `size` by `size` mesh
+/// spanning the square that holds `bounds`. `size` must be a power of two.
+///
+/// The force law is the softened 1/r^2 of the other solvers rather than the
+/// logarithmic potential of 2D Poisson, so instead of dividing by k^2 the
+/// deposited masses are convolved with the Green's function
+/// `-1 / sqrt(r^2 + s^2)` by FFT. The mesh cannot resolve anything below a
+/// cell, so `s` is at least the cell size.
+///
+/// With `range` set to `.long` only the long-range part is solved for; see
+/// `cutoff` and `longRange` for the rest.
+pub fn solve(
+    self: *@This(),
+    bodies: Bodies,
+    bounds: V2,
+    size: usize,
+    softening: Real,
+    range: Range,
+) !void {
+    std.debug.assert(size >= 2 and std.math.isPowerOfTwo(size));
+    const side = @max(bounds[0], bounds[1]);
+    const cell_size = side / @as(Real, @floatFromInt(size - 1));
+    const mesh_softening = @max(softening, cell_size);
+    const split: Real = switch (range) {
+        .full => 0,
+        .long => split_cells * cell_size,
+    };
+    if (size != self.size or cell_size != self.cell_size or
+        mesh_softening != self.softening or split != self.split)
+    {
+        try self.prepare(size, cell_size, mesh_softening, split);
+    }
+
+    const padded = 2 * size;
+    const work = self.work.items;
+    @memset(work, Complex.init(0, 0));
+    for (bodies.items(.x), bodies.items(.y), bodies.items(.mass)) |x, y, mass| {
+        const cell = self.locate(x, y);
+        const at = cell.y * padded + cell.x;
+        work[at].re += mass * (1 - cell.tx) * (1 - cell.ty);
+        work[at + 1].re += mass * cell.tx * (1 - cell.ty);
+        work[at + padded].re += mass * (1 - cell.tx) * cell.ty;
+        work[at + padded + 1].re += mass * cell.tx * cell.ty;
+    }
+
+    const twiddles = self.twiddles.items;
+    const column = self.column.items;
+    fft.transform2d(work, padded, size, twiddles, column, false);
+    for (work, self.green.items) |*value, green| value.* = value.mul(green);
+    fft.transform2d(work, padded, size, twiddles, column, true);
+
+    // a = -grad(phi), by central differences inside and one-sided ones at
+    // the edges.
+    const ax = self.ax.items;
+    const ay = self.ay.items;
+    for (0..size) |j| {
+        for (0..size) |i| {
+            const left = if (i > 0) i - 1 else i;
+            const right = if (i + 1 < size) i + 1 else i;
+            const down = if (j > 0) j - 1 else j;
+            const up = if (j + 1 < size) j + 1 else j;
+            const span_x = @as(Real, @floatFromInt(right - left)) * cell_size;
+            const span_y = @as(Real, @floatFromInt(up - down)) * cell_size;
+            ax[j * size + i] = -(work[j * padded + right].re - work[j * padded + left].re) / span_x;
+            ay[j * size + i] = -(work[up * padded + i].re - work[down * padded + i].re) / span_y;
+        }
+    }
+}
+
+/// Acceleration per unit `g` at (px, py), interpolated from the nodes with
+/// the same cloud-in-cell weights as the deposit, so away from the edges
+/// pair forces stay equal and opposite.
+pub fn accel(self: *const @This(), px: Real, py: Real) V2 {
+    const cell = self.locate(px, py);
+    const at = cell.y * self.size + cell.x;
+    const w00 = (1 - cell.tx) * (1 - cell.ty);
+    const w10 = cell.tx * (1 - cell.ty);
+    const w01 = (1 - cell.tx) * cell.ty;
+    const w11 = cell.tx * cell.ty;
+    const ax = self.ax.items;
+    const ay = self.ay.items;
+    const n = self.size;
+    return .{
+        ax[at] * w00 + ax[at + 1] * w10 + ax[at + n] * w01 + ax[at + n + 1] * w11,
+        ay[at] * w00 + ay[at + 1] * w10 + ay[at + n] * w01 + ay[at + n + 1] * w11,
+    };
+}
+
+/// Distance beyond which the short-range part of a `.long` solve is
+/// negligible.
+pub fn cutoff(self: *const @This()) Real {
+    return cutoff_splits * self.split;
+}
+
+/// The unsoftened long-range force per unit `g` and source mass, divided by
+/// the separation, at squared separation `dist_sq`. Subtracting this from
+/// the full pair force leaves the short-range part.
+pub fn longRange(self: *const @This(), dist_sq: Real) Real {
+    const split: f64 = self.split;
+    const x_sq = @as(f64, dist_sq) / (split * split);
+    const x = @sqrt(x_sq);
+    const two_over_sqrt_pi = 2 / @sqrt(std.math.pi);
+
+    // erf(x) / x^3 - 2 exp(-x^2) / (sqrt(pi) x^2), whose two terms cancel
+    // towards zero, so use its series there.
+    const scaled = if (x < 0.5)
+        two_over_sqrt_pi * (2.0 / 3.0 + x_sq * (-2.0 / 5.0 + x_sq * (1.0 / 7.0 +
+            x_sq * (-1.0 / 27.0 + x_sq / 132.0))))
+    else
+        erf(x) / (x_sq * x) - two_over_sqrt_pi * @exp(-x_sq) / x_sq;
+    return precision.cast(Real, scaled / (split * split * split));
+}
+
+/// Error function, to within 1.5e-7 (Abramowitz and Stegun 7.1.26).
+fn erf(x: f64) f64 {
+    const t = 1 / (1 + 0.3275911 * @abs(x));
+    const poly = t * (0.254829592 + t * (-0.284496736 + t * (1.421413741 +
+        t * (-1.453152027 + t * 1.061405429))));
+    const result = 1 - poly * @exp(-x * x);
+    return if (x < 0) -result else result;
+}
+
+/// Sizes the buffers for a new mesh and transforms its Green's function.
+fn prepare(self: *@This(), size: usize, cell_size: Real, softening: Real, split: Real) !void {
+    const padded = 2 * size;
+    try self.work.resize(padded * padded);
+    try self.green.resize(padded * padded);
+    try self.twiddles.resize(padded / 2);
+    try self.column.resize(padded);
+    try self.ax.resize(size * size);
+    try self.ay.resize(size * size);
+    self.size = size;
+    self.cell_size = cell_size;
+    self.softening = softening;
+    self.split = split;
+
+    fft.twiddles(self.twiddles.items);
+
+    // Offsets past the middle of the padded mesh wrap round to negative
+    // ones, which is what makes the periodic convolution isolated.
+    const softening_sq = softening * softening;
+    for (0..padded) |r| {
+        const dy = offset(r, size) * cell_size;
+        for (0..padded) |c| {
+            const dx = offset(c, size) * cell_size;
+            const dist_sq = dx * dx + dy * dy;
+            const potential = if (split == 0)
+                -1 / @sqrt(dist_sq + softening_sq)
+            else
+                longPotential(@sqrt(dist_sq), split);
+            self.green.items[r * padded + c] = Complex.init(potential, 0);
+        }
+    }
+    fft.transform2d(self.green.items, padded, padded, self.twiddles.items, self.column.items, false);
+}
+
+/// `-erf(r / split) / r`, the potential of a Gaussian of radius `split`.
+fn longPotential(dist: Real, split: Real) Real {
+    if (dist == 0) return -2 / (@sqrt(std.math.pi) * split);
+    return precision.cast(Real, -erf(@as(f64, dist) / split) / dist);
+}
+
+inline fn offset(index: usize, size: usize) Real {
+    const signed: isize = if (index <= size)
+        @intCast(index)
+    else
+        @as(isize, @intCast(index)) - @as(isize, @intCast(2 * size));
+    return @floatFromInt(signed);
+}
+
+/// The cell holding (px, py), clamped to the mesh.
+inline fn locate(self: *const @This(), px: Real, py: Real) Cell {
+    const last: Real = @floatFromInt(self.size - 2);
+    const fx = std.math.clamp(px / self.cell_size, 0, last + 1);
+    const fy = std.math.clamp(py / self.cell_size, 0, last + 1);
+    const ix = @min(@floor(fx), last);
+    const iy = @min(@floor(fy), last);
+    return .{
+        .x = @intFromFloat(ix),
+        .y = @intFromFloat(iy),
+        .tx = fx - ix,
+        .ty = fy - iy,
+    };
+}
+
+test "erf is within the Abramowitz and Stegun bound" {
+    const cases = [_][2]f64{
+        .{ 0, 0 },
+        .{ 0.5, 0.5204998778130465 },
+        .{ 1, 0.8427007929497149 },
+        .{ 2, 0.9953222650189527 },
+        .{ -1, -0.8427007929497149 },
+    };
+    for (cases) |case| try std.testing.expectApproxEqAbs(case[1], erf(case[0]), 2e-7);
+}
+
+test "longRange is continuous where it switches to its series" {
+    var mesh = init(std.testing.allocator);
+    defer mesh.deinit();
+    mesh.split = 0.01;
+
+    const crossover = 0.5 * mesh.split;
+    const below = mesh.longRange(std.math.pow(Real, crossover * (1 - 1e-4), 2));
+    const above = mesh.longRange(std.math.pow(Real, crossover * (1 + 1e-4), 2));
+    try std.testing.expectApproxEqRel(below, above, 1e-3);
+
+    // At the centre it is the force per unit distance of a Gaussian, and far
+    // out it is plain 1/r^3.
+    const split_cubed = mesh.split * mesh.split * mesh.split;
+    const centre = 4 / (3 * @sqrt(std.math.pi) * split_cubed);
+    try std.testing.expectApproxEqRel(centre, mesh.longRange(0), 1e-5);
+    const far = 6 * mesh.split;
+    try std.testing.expectApproxEqRel(1 / (far * far * far), mesh.longRange(far * far), 1e-5);
+}
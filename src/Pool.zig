@@ -0,0 +1,139 @@
+const std = @import("std");
+
+allocator: std.mem.Allocator,
+threads: []std.Thread,
+mutex: std.Thread.Mutex = .{},
+work_ready: std.Thread.Condition = .{},
+work_done: std.Thread.Condition = .{},
+generation: u64 = 0,
+pending: usize = 0,
+job: ?*Job = null,
+quit: bool = false,
+
+/// A range split into chunks that threads claim until none are left.
+const Job = struct {
+    context: *const anyopaque,
+    run: *const fn (context: *const anyopaque, start: usize, end: usize) void,
+    len: usize,
+    chunk: usize,
+    next: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    fn work(job: *Job) void {
+        while (true) {
+            const start = job.next.fetchAdd(job.chunk, .monotonic);
+            if (start >= job.len) return;
+            job.run(job.context, start, @min(start + job.chunk, job.len));
+        }
+    }
+};
+
+/// Starts a pool that runs jobs on `thread_count` threads, counting the
+/// caller of `parallelFor`. Zero means one thread per CPU.
+pub fn create(allocator: std.mem.Allocator, thread_count: usize) !*@This() {
+    const count = if (thread_count == 0) try std.Thread.getCpuCount() else thread_count;
+
+    const self = try allocator.create(@This());
+    errdefer allocator.destroy(self);
+    self.* = .{
+        .allocator = allocator,
+        .threads = try allocator.alloc(std.Thread, count - 1),
+    };
+    errdefer allocator.free(self.threads);
+
+    var spawned: usize = 0;
+    errdefer self.stop(self.threads[0..spawned]);
+    for (self.threads) |*thread| {
+        thread.* = try std.Thread.spawn(.{}, worker, .{self});
+        spawned += 1;
+    }
+
+    return self;
+}
+
+pub fn destroy(self: *@This()) void {
+    self.stop(self.threads);
+    self.allocator.free(self.threads);
+    self.allocator.destroy(self);
+}
+
+fn stop(self: *@This(), threads: []std.Thread) void {
+    self.mutex.lock();
+    self.quit = true;
+    self.work_ready.broadcast();
+    self.mutex.unlock();
+
+    for (threads) |thread| thread.join();
+}
+
+pub inline fn threadCount(self: @This()) usize {
+    return self.threads.len + 1;
+}
+
+/// Calls `func(context, start, end)` over chunks of `0..len` on every thread
+/// and returns once all of them are done. Chunks are disjoint, so each index
+/// is processed by exactly one thread.
+pub fn parallelFor(
+    self: *@This(),
+    len: usize,
+    chunk: usize,
+    context: anytype,
+    comptime func: fn (@TypeOf(context), usize, usize) void,
+) void {
+    const Context = @TypeOf(context);
+    const Wrapper = struct {
+        fn run(ptr: *const anyopaque, start: usize, end: usize) void {
+            const typed: *const Context = @ptrCast(@alignCast(ptr));
+            func(typed.*, start, end);
+        }
+    };
+
+    if (self.threads.len == 0 or len <= chunk) {
+        func(context, 0, len);
+        return;
+    }
+
+    var job = Job{
+        .context = &context,
+        .run = Wrapper.run,
+        .len = len,
+        .chunk = chunk,
+    };
+
+    self.mutex.lock();
+    self.job = &job;
+    self.pending = self.threads.len;
+    self.generation +%= 1;
+    self.work_ready.broadcast();
+    self.mutex.unlock();
+
+    job.work();
+
+    self.mutex.lock();
+    while (self.pending > 0) self.work_done.wait(&self.mutex);
+    self.job = null;
+    self.mutex.unlock();
+}
+
+fn worker(self: *@This()) void {
+    var seen: u64 = 0;
+    while (true) {
+        self.mutex.lock();
+        while (self.generation == seen and !self.quit) {
+            self.work_ready.wait(&self.mutex);
+        }
+        if (self.quit) {
+            self.mutex.unlock();
+            return;
+        }
+        seen = self.generation;
+        const job = self.job.?;
+        self.mutex.unlock();
+
+        job.work();
+
+        self.mutex.lock();
+        self.pending -= 1;
+        if (self.pending == 0) self.work_done.signal();
+        self.mutex.unlock();
+    }
+}
@@ -0,0 +1,1286 @@
+const BarnesHut = @import("BarnesHut.zig");
+pub const Bodies = @import("Bodies.zig");
+const FastMultipole = @import("FastMultipole.zig");
+const ParticleMesh = @import("ParticleMesh.zig");
+const Pool = @import("Pool.zig");
+const SpatialHash = @import("SpatialHash.zig");
+const SpatialSort = @import("SpatialSort.zig");
+const kernel = @import("kernel.zig");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const pow = std.math.pow;
+pub const Real = precision.Real;
+pub const V2 = @Vector(2, Real);
+
+allocator: std.mem.Allocator,
+g: Real = 3e-8,
+dt: Real = 1 / @as(Real, default_step_rate),
+max_steps_per_frame: u32 = 8,
+accumulator: Real = 0,
+bounds: V2 = .{ 16.0 / 9.0, 1 },
+solver: Solver = .direct,
+/// Plummer softening length. Every kernel uses `|d|^2 + softening^2` as the
+/// squared distance, so forces stay finite and smooth at close range. Must
+/// be positive.
+softening: Real = default_softening,
+integrator: Integrator = .euler,
+collisions: Collisions = .none,
+/// Sweep bodies along their paths each drift, stopping them at their first
+/// contact, so fast bodies cannot pass through each other or the walls.
+/// Yoshida's backward drift is not swept, and Hermite, which moves bodies
+/// by its predictor rather than by drifts, is not swept at all.
+ccd: bool = false,
+theta: Real = 0.5,
+/// Nodes along each side of the `particle_mesh` grid. A power of two.
+mesh_size: usize = 256,
+/// Expansion order of the `fmm` solver, up to `FastMultipole.max_order`.
+fmm_order: usize = 6,
+/// Steps between reordering the bodies along `reorder_curve`, so that
+/// neighbours in space are neighbours in memory for the solvers and the
+/// collision pass. Zero never reorders. Bodies keep their IDs.
+reorder_interval: u32 = 0,
+reorder_curve: Curve = .hilbert,
+steps_since_reorder: u32 = 0,
+bodies: Bodies = undefined,
+/// This and the scratch state down to `active` are rebuilt whenever they
+/// are used but keep their buffers from one use to the next, so once they
+/// have grown to fit the bodies, stepping allocates nothing.
+tree: BarnesHut = undefined,
+grid: SpatialHash = undefined,
+spatial_sort: SpatialSort = undefined,
+mesh: ParticleMesh = undefined,
+multipole: FastMultipole = undefined,
+/// First contact of each body within the current sweep.
+impacts: std.ArrayListUnmanaged(Impact) = .{},
+/// Bodies swallowed during the current merge pass.
+absorbed: std.DynamicBitSetUnmanaged = .{},
+/// Start-of-step state kept by the Hermite corrector.
+saved: Bodies = undefined,
+/// Bodies due for a force evaluation on the current block sub-step.
+active: std.ArrayListUnmanaged(u32) = .{},
+/// Scales the block timestep each body asks for; smaller is more accurate.
+timestep_accuracy: Real = 0.1,
+/// Per-body force evaluations so far, for benchmarks.
+evaluations: u64 = 0,
+pool: ?*Pool = null,
+/// Whether `ax`/`ay` no longer match the current positions. The symplectic
+/// integrators reuse the forces from the end of the previous step.
+accelerations_stale: bool = true,
+/// Whether `jx`/`jy` no longer match the current state. Only Hermite
+/// evaluates jerks, so any other force evaluation marks them stale.
+jerks_stale: bool = true,
+
+pub const default_step_rate = 120;
+pub const default_softening = 0.002;
+const collision_dampen_factor = 0.3;
+/// Fraction of their summed radii by which bodies may be apart and still
+/// count as touching, so pairs stopped at their time of impact by a sweep
+/// are resolved despite rounding.
+const contact_slop = 1e-4;
+/// Cells each body's path crosses on average in a sweep's broad phase.
+const swept_cells_per_body = 4;
+/// Deepest block timestep level, i.e. the shortest step is `dt / 2^this`.
+pub const max_block_level = 8;
+const rows_per_chunk = 64;
+
+pub const Body = Bodies.Body;
+pub const Curve = SpatialSort.Curve;
+
+pub const Solver = enum {
+    /// Exact O(n^2) sum, vectorized over `kernel.lanes` sources at a time.
+    direct,
+    /// Exact O(n^2) sum, one pair at a time. Reference for `direct`.
+    direct_scalar,
+    /// O(n log n) quadtree approximation controlled by `theta`. Every full
+    /// evaluation also sorts the bodies into the tree's order, so indices
+    /// change from step to step; `Bodies.Id`s follow the bodies.
+    barnes_hut,
+    /// O(n + m log m) particle-mesh solve on an m = `mesh_size`^2 grid over
+    /// the bounds. Smooth at the scale of a cell, so for large, diffuse
+    /// distributions rather than close encounters.
+    particle_mesh,
+    /// Particle-particle particle-mesh: the long-range part of the force on
+    /// the mesh and the rest by direct sum over neighbours within a few
+    /// cells, found with the spatial hash. Close to direct-sum accuracy at
+    /// close range, near O(n log n) overall.
+    p3m,
+    /// O(n) fast multipole method: Taylor expansions of order `fmm_order` on
+    /// a uniform quadtree, with a direct sum between adjacent leaves.
+    fmm,
+};
+
+pub const Integrator = enum {
+    /// First order semi-implicit Euler: kick with the current forces, then
+    /// drift. Energy drifts steadily, so orbits need small steps.
+    euler,
+    /// Second order kick-drift-kick leapfrog. Symplectic, so energy errors
+    /// stay bounded, and still one force evaluation per step.
+    leapfrog,
+    /// Velocity Verlet in its textbook form, drifting with `v dt + a dt^2 / 2`
+    /// and kicking with the mean of the old and new forces. The same
+    /// trajectory as `leapfrog` up to rounding.
+    velocity_verlet,
+    /// Fourth order Yoshida composition of three leapfrog steps, one of them
+    /// backwards. Symplectic; three force evaluations per step.
+    yoshida,
+    /// Fourth order Hermite predictor-corrector, using the jerk as well as the
+    /// acceleration. One evaluation per step, always by direct sum whatever
+    /// the solver, since the tree does not provide jerks. Not symplectic, but
+    /// very accurate at moderate steps.
+    hermite,
+    /// Kick-drift-kick leapfrog with power-of-two block timesteps. Each body
+    /// steps by `dt / 2^level`, with its level picked from its acceleration,
+    /// and only the bodies at the end of their step have their forces
+    /// recomputed. Clustered scenes no longer run entirely at the pace of
+    /// their tightest pair.
+    block,
+};
+
+/// Leapfrog step fractions of the Yoshida integrator: w1, w0, w1 with
+/// w1 = 1 / (2 - 2^(1/3)) and w0 = 1 - 2 w1.
+const yoshida_weights = [3]Real{
+    1.3512071919596578,
+    -1.7024143839193153,
+    1.3512071919596578,
+};
+
+/// How bodies respond to touching each other. Walls always bounce.
+pub const Collisions = enum {
+    /// Bodies pass through each other.
+    none,
+    /// Touching bodies are pushed apart and bounce without losing energy.
+    elastic,
+    /// Like `elastic`, but the bounce keeps only `collision_dampen_factor` of
+    /// the approach speed.
+    inelastic,
+    /// Touching bodies fuse into one, conserving mass, momentum and area.
+    /// The absorbed body is swap-removed, so bodies change index.
+    merge,
+};
+
+/// Initial conditions for `spawn`.
+pub const Scene = enum {
+    /// Stationary bodies scattered uniformly over the bounds.
+    random,
+    /// Light bodies on circular orbits around one heavy central body.
+    disc,
+    /// Cold, dense clumps that collapse into close encounters.
+    clusters,
+};
+
+pub fn init(sim: @This()) @This() {
+    var result = sim;
+    result.bodies = Bodies.init(result.allocator);
+    result.tree = BarnesHut.init(result.allocator);
+    result.grid = SpatialHash.init(result.allocator);
+    result.spatial_sort = SpatialSort.init(result.allocator);
+    result.mesh = ParticleMesh.init(result.allocator);
+    result.multipole = FastMultipole.init(result.allocator);
+    result.saved = Bodies.init(result.allocator);
+    return result;
+}
+
+pub fn deinit(self: *@This()) void {
+    self.bodies.deinit();
+    self.tree.deinit();
+    self.grid.deinit();
+    self.spatial_sort.deinit();
+    self.mesh.deinit();
+    self.multipole.deinit();
+    self.absorbed.deinit(self.allocator);
+    self.impacts.deinit(self.allocator);
+    self.saved.deinit();
+    self.active.deinit(self.allocator);
+    if (self.pool) |pool| pool.destroy();
+}
+
+pub fn add(self: *@This(), body: Body) !void {
+    try self.bodies.append(body);
+    self.accelerations_stale = true;
+}
+
+pub fn clear(self: *@This()) void {
+    self.bodies.clear();
+    self.accelerations_stale = true;
+}
+
+pub inline fn massFromRadius(radius: Real) Real {
+    return pow(Real, radius * 1000, 3);
+}
+
+pub fn spawn(self: *@This(), scene: Scene, count: usize, seed: u64) !void {
+    switch (scene) {
+        .random => try self.spawnRandom(count, seed),
+        .disc => try self.spawnDisc(count, seed),
+        .clusters => try self.spawnClusters(count, seed),
+    }
+}
+
+/// Scatters `count` stationary bodies uniformly over the world bounds.
+pub fn spawnRandom(self: *@This(), count: usize, seed: u64) !void {
+    const min_radius = 0.002;
+    const max_radius = 0.006;
+
+    var prng = std.rand.DefaultPrng.init(seed);
+    const random = prng.random();
+
+    try self.bodies.ensureUnusedCapacity(count);
+    for (0..count) |_| {
+        const radius = min_radius + (max_radius - min_radius) * random.float(Real);
+        const span = self.bounds - @as(V2, @splat(2 * radius));
+        const offset = V2{ random.float(Real), random.float(Real) };
+        self.bodies.appendAssumeCapacity(.{
+            .mass = massFromRadius(radius),
+            .radius = radius,
+            .pos = @as(V2, @splat(radius)) + offset * span,
+        });
+    }
+    self.accelerations_stale = true;
+}
+
+/// Places a heavy body in the middle of the bounds and `count` light bodies
+/// on circular orbits around it. The light bodies are too small to perturb
+/// each other much, which makes this a good scene for checking integrators.
+pub fn spawnDisc(self: *@This(), count: usize, seed: u64) !void {
+    const central_radius = 0.05;
+    const min_orbit = 0.1;
+    const max_orbit = 0.4;
+    const min_radius = 0.002;
+    const max_radius = 0.004;
+
+    var prng = std.rand.DefaultPrng.init(seed);
+    const random = prng.random();
+
+    const center = self.bounds * @as(V2, @splat(0.5));
+    const central_mass = massFromRadius(central_radius);
+
+    try self.bodies.ensureUnusedCapacity(count + 1);
+    self.bodies.appendAssumeCapacity(.{
+        .mass = central_mass,
+        .radius = central_radius,
+        .pos = center,
+    });
+    for (0..count) |_| {
+        const radius = min_radius + (max_radius - min_radius) * random.float(Real);
+        const orbit = min_orbit + (max_orbit - min_orbit) * random.float(Real);
+        const angle = std.math.tau * random.float(Real);
+        const direction = V2{ @cos(angle), @sin(angle) };
+        const speed = @sqrt(self.g * central_mass / orbit);
+        self.bodies.appendAssumeCapacity(.{
+            .mass = massFromRadius(radius),
+            .radius = radius,
+            .pos = center + direction * @as(V2, @splat(orbit)),
+            .velocity = V2{ -direction[1], direction[0] } * @as(V2, @splat(speed)),
+        });
+    }
+    self.accelerations_stale = true;
+}
+
+/// Splits `count` stationary bodies between a few tight Gaussian clumps.
+pub fn spawnClusters(self: *@This(), count: usize, seed: u64) !void {
+    const cluster_count = 8;
+    const spread = 0.02;
+    const margin = 0.1;
+    const min_radius = 0.001;
+    const max_radius = 0.003;
+
+    var prng = std.rand.DefaultPrng.init(seed);
+    const random = prng.random();
+
+    var centers: [cluster_count]V2 = undefined;
+    for (&centers) |*center| {
+        const offset = V2{ random.float(Real), random.float(Real) };
+        center.* = @as(V2, @splat(margin)) + offset * (self.bounds - @as(V2, @splat(2 * margin)));
+    }
+
+    try self.bodies.ensureUnusedCapacity(count);
+    for (0..count) |i| {
+        const radius = min_radius + (max_radius - min_radius) * random.float(Real);
+        const offset = V2{ random.floatNorm(Real), random.floatNorm(Real) };
+        self.bodies.appendAssumeCapacity(.{
+            .mass = massFromRadius(radius),
+            .radius = radius,
+            .pos = centers[i % cluster_count] + offset * @as(V2, @splat(spread)),
+        });
+    }
+    self.accelerations_stale = true;
+}
+
+/// Runs as many fixed steps as fit in the time accumulated so far. At most
+/// `max_steps_per_frame` steps are taken per call; when that is not enough
+/// the backlog is dropped so one slow frame cannot snowball into the next.
+pub fn advance(self: *@This(), frame_time: Real) !void {
+    self.accumulator += frame_time;
+
+    var steps: u32 = 0;
+    while (self.accumulator >= self.dt) : (steps += 1) {
+        if (steps == self.max_steps_per_frame) {
+            self.accumulator = @mod(self.accumulator, self.dt);
+            break;
+        }
+        try self.step();
+        self.accumulator -= self.dt;
+    }
+}
+
+/// Computes every acceleration before moving any body, so the result does
+/// not depend on the order of `bodies`.
+pub fn step(self: *@This()) !void {
+    if (self.reorder_interval > 0) {
+        self.steps_since_reorder += 1;
+        if (self.steps_since_reorder >= self.reorder_interval) {
+            self.steps_since_reorder = 0;
+            try self.spatial_sort.sort(self.bodies, self.reorder_curve, self.pool);
+        }
+    }
+
+    const bodies = self.bodies;
+    @memcpy(bodies.items(.prev_x), bodies.items(.x));
+    @memcpy(bodies.items(.prev_y), bodies.items(.y));
+
+    switch (self.integrator) {
+        .euler => {
+            try self.computeAccelerations();
+            self.kick(self.dt);
+            _ = try self.computeCollisions();
+            try self.drift(self.dt);
+        },
+        .leapfrog => {
+            if (self.accelerations_stale) try self.computeAccelerations();
+            try self.leapfrog(self.dt);
+        },
+        .velocity_verlet => {
+            if (self.accelerations_stale) try self.computeAccelerations();
+            if (self.ccd) {
+                // The whole move, `v dt + a dt^2 / 2`, is a drift at the
+                // half-kicked velocity, so a sweep sees all of it.
+                self.kick(self.dt / 2);
+                try self.drift(self.dt);
+            } else {
+                const half_dt_sq = self.dt * self.dt / 2;
+                try self.drift(self.dt);
+                scaleAdd(bodies.items(.x), bodies.items(.ax), half_dt_sq);
+                scaleAdd(bodies.items(.y), bodies.items(.ay), half_dt_sq);
+                self.kick(self.dt / 2);
+            }
+            _ = try self.computeCollisions();
+            try self.computeAccelerations();
+            self.kick(self.dt / 2);
+        },
+        .yoshida => {
+            if (self.accelerations_stale) try self.computeAccelerations();
+            for (yoshida_weights) |weight| try self.leapfrog(self.dt * weight);
+        },
+        .hermite => {
+            if (self.accelerations_stale or self.jerks_stale) {
+                try self.computeAccelerationsAndJerks();
+            }
+            try self.hermite(self.dt);
+        },
+        .block => try self.blockStep(),
+    }
+}
+
+/// One kick-drift-kick step of length `dt`, starting from valid forces.
+fn leapfrog(self: *@This(), dt: Real) !void {
+    self.kick(dt / 2);
+    try self.drift(dt);
+    _ = try self.computeCollisions();
+    try self.computeAccelerations();
+    self.kick(dt / 2);
+}
+
+/// One Hermite step of length `dt`: predict positions and velocities from a
+/// Taylor series in the current acceleration and jerk, evaluate both at the
+/// prediction, then correct with the interpolating polynomial.
+fn hermite(self: *@This(), dt: Real) !void {
+    const bodies = self.bodies;
+    try self.saved.resize(bodies.len);
+
+    inline for (.{ "x", "y" }) |name| {
+        const now = Axis.of(bodies, name);
+        const start = Axis.of(self.saved, name);
+        inline for (@typeInfo(Axis).Struct.fields) |field| {
+            @memcpy(@field(start, field.name), @field(now, field.name));
+        }
+        for (now.pos, now.vel, now.acc, now.jerk) |*pos, *vel, acc, jerk| {
+            pos.* += dt * (vel.* + dt * (acc / 2 + dt * jerk / 6));
+            vel.* += dt * (acc + dt * jerk / 2);
+        }
+    }
+
+    try self.computeAccelerationsAndJerks();
+
+    const dt_sq_12 = dt * dt / 12;
+    inline for (.{ "x", "y" }) |name| {
+        const now = Axis.of(bodies, name);
+        const start = Axis.of(self.saved, name);
+        for (0..bodies.len) |i| {
+            const vel = start.vel[i] + dt / 2 * (start.acc[i] + now.acc[i]) +
+                dt_sq_12 * (start.jerk[i] - now.jerk[i]);
+            now.pos[i] = start.pos[i] + dt / 2 * (start.vel[i] + vel) +
+                dt_sq_12 * (start.acc[i] - now.acc[i]);
+            now.vel[i] = vel;
+        }
+    }
+
+    // Contacts push overlapping bodies apart and walls clamp them back in,
+    // so after any collision both the accelerations and the jerks are off.
+    if (try self.computeCollisions()) {
+        self.accelerations_stale = true;
+        self.jerks_stale = true;
+    }
+}
+
+/// One global step of `dt` made of block sub-steps. Time is counted in ticks
+/// of the deepest level, `dt / 2^max_block_level`, so every body's step is a
+/// whole number of ticks and all of them end together at the last tick.
+fn blockStep(self: *@This()) !void {
+    const ticks: u32 = 1 << max_block_level;
+    const tick_dt = self.dt / @as(Real, @floatFromInt(ticks));
+
+    if (self.accelerations_stale) {
+        try self.computeAccelerations();
+        const level = self.bodies.items(.level);
+        for (level, 0..) |*l, i| l.* = @floatFromInt(self.blockLevel(i, 0));
+    }
+    for (0..self.bodies.len) |i| self.kickOne(i, self.blockDt(i) / 2);
+
+    var time: u32 = 0;
+    while (time < ticks) {
+        var deepest: Real = 0;
+        for (self.bodies.items(.level)) |l| deepest = @max(deepest, l);
+        // Round up rather than add: a merge can take away the only body at
+        // the deepest level partway through its parent's step, leaving
+        // `time` off the boundaries of the new deepest level.
+        const stride = ticks >> @as(u5, @intFromFloat(deepest));
+        const next = (time / stride + 1) * stride;
+
+        try self.drift(@as(Real, @floatFromInt(next - time)) * tick_dt);
+        time = next;
+        // Merging can remove bodies, so nothing from before this call is
+        // indexed past it.
+        _ = try self.computeCollisions();
+
+        const level = self.bodies.items(.level);
+        self.active.clearRetainingCapacity();
+        for (level, 0..) |l, i| {
+            if (time % (ticks >> @as(u5, @intFromFloat(l))) == 0) {
+                try self.active.append(self.allocator, @intCast(i));
+            }
+        }
+        try self.computeAccelerationsOf(self.active.items);
+
+        for (self.active.items) |i| {
+            self.kickOne(i, self.blockDt(i) / 2);
+            level[i] = @floatFromInt(self.blockLevel(i, time));
+            if (time < ticks) self.kickOne(i, self.blockDt(i) / 2);
+        }
+    }
+    std.debug.assert(time == ticks);
+    self.accelerations_stale = false;
+    self.jerks_stale = true;
+}
+
+/// The level body `i` asks for, `dt_i = accuracy * sqrt(softening / |a|)`,
+/// limited to levels whose steps start on tick `time`. Bodies can always
+/// move deeper, but only move up where the longer step would begin.
+fn blockLevel(self: @This(), i: usize, time: u32) u8 {
+    const ticks: u32 = 1 << max_block_level;
+    const bodies = self.bodies;
+    const accel = @sqrt(bodies.items(.ax)[i] * bodies.items(.ax)[i] +
+        bodies.items(.ay)[i] * bodies.items(.ay)[i]);
+    const wanted = self.timestep_accuracy * @sqrt(self.softening / accel);
+
+    var level: u8 = if (wanted < self.dt)
+        @intFromFloat(@min(@ceil(@log2(self.dt / wanted)), max_block_level))
+    else
+        0;
+    while (time % (ticks >> @as(u5, @intCast(level))) != 0) level += 1;
+    return level;
+}
+
+inline fn blockDt(self: @This(), i: usize) Real {
+    return self.dt / std.math.exp2(self.bodies.items(.level)[i]);
+}
+
+inline fn kickOne(self: @This(), i: usize, dt: Real) void {
+    const bodies = self.bodies;
+    bodies.items(.vx)[i] += bodies.items(.ax)[i] * dt;
+    bodies.items(.vy)[i] += bodies.items(.ay)[i] * dt;
+}
+
+/// The state along one axis, as used by `hermite`.
+const Axis = struct {
+    pos: []Real,
+    vel: []Real,
+    acc: []Real,
+    jerk: []Real,
+
+    fn of(bodies: Bodies, comptime name: []const u8) Axis {
+        return .{
+            .pos = bodies.items(@field(Bodies.Field, name)),
+            .vel = bodies.items(@field(Bodies.Field, "v" ++ name)),
+            .acc = bodies.items(@field(Bodies.Field, "a" ++ name)),
+            .jerk = bodies.items(@field(Bodies.Field, "j" ++ name)),
+        };
+    }
+};
+
+/// Moves every velocity by its acceleration over `dt`.
+fn kick(self: *@This(), dt: Real) void {
+    const bodies = self.bodies;
+    scaleAdd(bodies.items(.vx), bodies.items(.ax), dt);
+    scaleAdd(bodies.items(.vy), bodies.items(.ay), dt);
+}
+
+/// Moves every position by its velocity over `dt`, swept if `ccd` is set.
+/// Backward drifts, as in the Yoshida composition, are never swept.
+fn drift(self: *@This(), dt: Real) !void {
+    if (self.ccd and dt > 0) return self.sweep(dt);
+    const bodies = self.bodies;
+    scaleAdd(bodies.items(.x), bodies.items(.vx), dt);
+    scaleAdd(bodies.items(.y), bodies.items(.vy), dt);
+}
+
+/// The earliest contact found for one body during a sweep.
+const Impact = struct {
+    time: Real,
+    wall: enum { none, x, y } = .none,
+};
+
+/// Drifts each body up to its first time of impact within `dt`, against the
+/// walls and, when collisions are on, against other bodies found through a
+/// swept broad phase. Bodies reaching a wall bounce off it here. Bodies
+/// reaching each other are left touching for the next contact pass: the one
+/// right after the drift for the kick-drift-kick integrators, or the next
+/// step's for Euler, which resolves contacts before it drifts. Either way a
+/// body that hits something gives up the rest of its drift for this step.
+fn sweep(self: *@This(), dt: Real) !void {
+    const bodies = self.bodies;
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const vx = bodies.items(.vx);
+    const vy = bodies.items(.vy);
+    const radius = bodies.items(.radius);
+
+    try self.impacts.resize(self.allocator, bodies.len);
+    const impacts = self.impacts.items;
+    for (impacts, x, y, vx, vy, radius) |*impact, px, py, v_x, v_y, r| {
+        impact.* = .{ .time = dt };
+        const time_x = wallImpact(px, v_x, r, self.bounds[0]);
+        const time_y = wallImpact(py, v_y, r, self.bounds[1]);
+        if (time_x < impact.time) impact.* = .{ .time = time_x, .wall = .x };
+        if (time_y < impact.time) impact.* = .{ .time = time_y, .wall = .y };
+    }
+
+    if (self.collisions != .none and bodies.len > 1) {
+        // Two bodies can only meet if their paths come within the sum of
+        // their radii of each other, so with cells at least that wide the
+        // paths pass through neighbouring cells. Cells are also made wide
+        // enough that the paths cross `swept_cells_per_body` of them on
+        // average, so a few fast bodies cannot blow up the entry count.
+        var max_radius: Real = 0;
+        var travel: Real = 0;
+        for (radius, vx, vy) |r, v_x, v_y| {
+            max_radius = @max(max_radius, r);
+            travel += (@abs(v_x) + @abs(v_y)) * dt;
+        }
+        const path_budget = swept_cells_per_body * @as(Real, @floatFromInt(bodies.len));
+        const cell_size = @max(2 * max_radius, travel / path_budget);
+        try self.grid.buildSwept(x, y, vx, vy, dt, cell_size);
+
+        for (0..bodies.len) |i| {
+            var cells = self.grid.path(x[i], y[i], vx[i] * dt, vy[i] * dt);
+            while (cells.next()) |cell| {
+                const buckets = self.grid.nearCell(cell[0], cell[1]);
+                for (buckets.slice()) |bucket| {
+                    for (self.grid.entriesOf(bucket)) |j| {
+                        if (j <= i) continue;
+                        const time = pairImpact(bodies, i, j) orelse continue;
+                        if (time < impacts[i].time) impacts[i] = .{ .time = time };
+                        if (time < impacts[j].time) impacts[j] = .{ .time = time };
+                    }
+                }
+            }
+        }
+    }
+
+    for (impacts, x, y, vx, vy) |impact, *px, *py, *v_x, *v_y| {
+        px.* += v_x.* * impact.time;
+        py.* += v_y.* * impact.time;
+        switch (impact.wall) {
+            .none => {},
+            .x => v_x.* *= -collision_dampen_factor,
+            .y => v_y.* *= -collision_dampen_factor,
+        }
+    }
+}
+
+/// Time until a circle at `pos` moving at `velocity` along one axis touches
+/// either wall, or infinity if it is moving parallel to them or is already
+/// touching the one it is heading for.
+fn wallImpact(pos: Real, velocity: Real, radius: Real, bound: Real) Real {
+    const gap = if (velocity < 0) pos - radius else bound - radius - pos;
+    if (velocity == 0 or gap <= 0) return std.math.inf(Real);
+    return gap / @abs(velocity);
+}
+
+/// Time until bodies `i` and `j` first touch, the smaller root of
+/// `|d + w t| = r_i + r_j` for separation `d` and relative velocity `w`, or
+/// null if they are already touching or not closing.
+fn pairImpact(bodies: Bodies, i: usize, j: usize) ?Real {
+    const d = V2{
+        bodies.items(.x)[j] - bodies.items(.x)[i],
+        bodies.items(.y)[j] - bodies.items(.y)[i],
+    };
+    const w = V2{
+        bodies.items(.vx)[j] - bodies.items(.vx)[i],
+        bodies.items(.vy)[j] - bodies.items(.vy)[i],
+    };
+    const contact = bodies.items(.radius)[i] + bodies.items(.radius)[j];
+
+    const a = w[0] * w[0] + w[1] * w[1];
+    const b = d[0] * w[0] + d[1] * w[1];
+    const c = d[0] * d[0] + d[1] * d[1] - contact * contact;
+    if (c <= 0 or b >= 0) return null;
+
+    const discriminant = b * b - a * c;
+    if (discriminant < 0) return null;
+    return c / (-b + @sqrt(discriminant));
+}
+
+fn scaleAdd(values: []Real, rates: []const Real, scale: Real) void {
+    for (values, rates) |*value, rate| value.* += rate * scale;
+}
+
+/// Fills the `ax`/`ay` arrays with the gravitational acceleration of each
+/// body using the selected solver.
+pub fn computeAccelerations(self: *@This()) !void {
+    const bodies = self.bodies;
+    switch (self.solver) {
+        .direct => self.forEachBody(DirectRows{
+            .sources = self.gravitySources(),
+            .ax = bodies.items(.ax),
+            .ay = bodies.items(.ay),
+            .g = self.g,
+        }, DirectRows.run),
+        .direct_scalar => self.computeInteractions(),
+        .barnes_hut => {
+            try self.tree.build(bodies, self.pool);
+            // Nothing holds body indices across a full evaluation, so leave
+            // the bodies in tree order for the traversals that follow.
+            try self.tree.sortBodies(bodies, self.pool);
+            self.forEachBody(TreeRows{
+                .tree = &self.tree,
+                .bodies = bodies,
+                .theta = self.theta,
+                .softening_sq = self.softening * self.softening,
+                .g = self.g,
+            }, TreeRows.run);
+        },
+        .particle_mesh => {
+            try self.mesh.solve(bodies, self.bounds, self.mesh_size, self.softening, .full);
+            self.forEachBody(MeshRows{
+                .mesh = &self.mesh,
+                .bodies = bodies,
+                .g = self.g,
+            }, MeshRows.run);
+        },
+        .p3m => {
+            try self.solveLongRange();
+            self.forEachBody(MeshRows{
+                .mesh = &self.mesh,
+                .bodies = bodies,
+                .g = self.g,
+                .near = self.nearSources(),
+            }, MeshRows.run);
+        },
+        .fmm => {
+            try self.multipole.solve(bodies, self.fmm_order, self.softening, self.pool);
+            self.forEachBody(MultipoleRows{
+                .multipole = &self.multipole,
+                .sources = self.gravitySources(),
+                .bodies = bodies,
+                .g = self.g,
+            }, MultipoleRows.run);
+        },
+    }
+    self.accelerations_stale = false;
+    self.jerks_stale = true;
+    self.evaluations += bodies.len;
+}
+
+/// Like `computeAccelerations`, but only for the bodies listed in `indices`.
+/// Every body still acts as a source.
+pub fn computeAccelerationsOf(self: *@This(), indices: []const u32) !void {
+    const bodies = self.bodies;
+    switch (self.solver) {
+        .direct, .direct_scalar => |solver| self.forEachIndex(indices, DirectRows{
+            .sources = self.gravitySources(),
+            .ax = bodies.items(.ax),
+            .ay = bodies.items(.ay),
+            .g = self.g,
+            .scalar = solver == .direct_scalar,
+        }),
+        .barnes_hut => {
+            try self.tree.build(bodies, self.pool);
+            self.forEachIndex(indices, TreeRows{
+                .tree = &self.tree,
+                .bodies = bodies,
+                .theta = self.theta,
+                .softening_sq = self.softening * self.softening,
+                .g = self.g,
+            });
+        },
+        .particle_mesh => {
+            try self.mesh.solve(bodies, self.bounds, self.mesh_size, self.softening, .full);
+            self.forEachIndex(indices, MeshRows{
+                .mesh = &self.mesh,
+                .bodies = bodies,
+                .g = self.g,
+            });
+        },
+        .p3m => {
+            try self.solveLongRange();
+            self.forEachIndex(indices, MeshRows{
+                .mesh = &self.mesh,
+                .bodies = bodies,
+                .g = self.g,
+                .near = self.nearSources(),
+            });
+        },
+        .fmm => {
+            try self.multipole.solve(bodies, self.fmm_order, self.softening, self.pool);
+            self.forEachIndex(indices, MultipoleRows{
+                .multipole = &self.multipole,
+                .sources = self.gravitySources(),
+                .bodies = bodies,
+                .g = self.g,
+            });
+        },
+    }
+    self.jerks_stale = true;
+    self.evaluations += indices.len;
+}
+
+/// Fills `ax`/`ay` and `jx`/`jy` by direct sum, for the Hermite integrator.
+pub fn computeAccelerationsAndJerks(self: *@This()) !void {
+    const bodies = self.bodies;
+    self.forEachBody(JerkRows{
+        .sources = self.gravitySources(),
+        .vx = bodies.items(.vx),
+        .vy = bodies.items(.vy),
+        .bodies = bodies,
+        .g = self.g,
+    }, JerkRows.run);
+    self.accelerations_stale = false;
+    self.jerks_stale = false;
+    self.evaluations += bodies.len;
+}
+
+/// Total kinetic and softened gravitational potential energy, summed in
+/// f64. O(n^2).
+pub fn energy(self: @This()) f64 {
+    const bodies = self.bodies;
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const vx = bodies.items(.vx);
+    const vy = bodies.items(.vy);
+    const mass = bodies.items(.mass);
+
+    const softening_sq = @as(f64, self.softening) * self.softening;
+    var kinetic: f64 = 0;
+    var potential: f64 = 0;
+    for (0..bodies.len) |i| {
+        const v_sq = @as(f64, vx[i]) * vx[i] + @as(f64, vy[i]) * vy[i];
+        kinetic += 0.5 * @as(f64, mass[i]) * v_sq;
+        for (i + 1..bodies.len) |j| {
+            const dx = @as(f64, x[j]) - x[i];
+            const dy = @as(f64, y[j]) - y[i];
+            const dist = @sqrt(dx * dx + dy * dy + softening_sq);
+            potential -= @as(f64, mass[i]) * mass[j] / dist;
+        }
+    }
+    return kinetic + potential * self.g;
+}
+
+/// Runs `func` over every body index, split across the pool if there is one.
+/// Each body is handled by exactly one thread, so results do not depend on
+/// the thread count.
+fn forEachBody(
+    self: *@This(),
+    context: anytype,
+    comptime func: fn (@TypeOf(context), usize, usize) void,
+) void {
+    if (self.pool) |pool| {
+        pool.parallelFor(self.bodies.len, rows_per_chunk, context, func);
+    } else {
+        func(context, 0, self.bodies.len);
+    }
+}
+
+/// Runs `rows.row` for each body in `indices`, split across the pool if
+/// there is one.
+fn forEachIndex(self: *@This(), indices: []const u32, rows: anytype) void {
+    const Rows = @TypeOf(rows);
+    const Subset = struct {
+        rows: Rows,
+        indices: []const u32,
+
+        fn run(subset: @This(), start: usize, end: usize) void {
+            for (subset.indices[start..end]) |i| subset.rows.row(i);
+        }
+    };
+    const subset = Subset{ .rows = rows, .indices = indices };
+    if (self.pool) |pool| {
+        pool.parallelFor(indices.len, rows_per_chunk, subset, Subset.run);
+    } else {
+        subset.run(0, indices.len);
+    }
+}
+
+const DirectRows = struct {
+    sources: kernel.Sources,
+    ax: []Real,
+    ay: []Real,
+    g: Real,
+    scalar: bool = false,
+
+    fn run(self: @This(), start: usize, end: usize) void {
+        for (start..end) |i| self.row(i);
+    }
+
+    fn row(self: @This(), i: usize) void {
+        const accel = if (self.scalar)
+            kernel.accelScalar(self.sources, i)
+        else
+            kernel.accel(self.sources, i);
+        self.ax[i] = accel[0] * self.g;
+        self.ay[i] = accel[1] * self.g;
+    }
+};
+
+const JerkRows = struct {
+    sources: kernel.Sources,
+    vx: []const Real,
+    vy: []const Real,
+    bodies: Bodies,
+    g: Real,
+
+    fn run(self: @This(), start: usize, end: usize) void {
+        const ax = self.bodies.items(.ax);
+        const ay = self.bodies.items(.ay);
+        const jx = self.bodies.items(.jx);
+        const jy = self.bodies.items(.jy);
+        for (start..end) |i| {
+            const result = kernel.accelJerk(self.sources, self.vx, self.vy, i);
+            ax[i] = result.accel[0] * self.g;
+            ay[i] = result.accel[1] * self.g;
+            jx[i] = result.jerk[0] * self.g;
+            jy[i] = result.jerk[1] * self.g;
+        }
+    }
+};
+
+const TreeRows = struct {
+    tree: *const BarnesHut,
+    bodies: Bodies,
+    theta: Real,
+    softening_sq: Real,
+    g: Real,
+
+    fn run(self: @This(), start: usize, end: usize) void {
+        for (start..end) |i| self.row(i);
+    }
+
+    fn row(self: @This(), i: usize) void {
+        const accel = self.tree.accel(self.bodies, i, self.theta, self.softening_sq);
+        self.bodies.items(.ax)[i] = accel[0] * self.g;
+        self.bodies.items(.ay)[i] = accel[1] * self.g;
+    }
+};
+
+/// Solves the long-range part of a P3M evaluation on the mesh and hashes
+/// the bodies into cells of its cutoff for the short-range part.
+fn solveLongRange(self: *@This()) !void {
+    const bodies = self.bodies;
+    try self.mesh.solve(bodies, self.bounds, self.mesh_size, self.softening, .long);
+    try self.grid.build(bodies.items(.x), bodies.items(.y), self.mesh.cutoff());
+}
+
+fn nearSources(self: *const @This()) NearSources {
+    const cutoff = self.mesh.cutoff();
+    return .{
+        .sources = self.gravitySources(),
+        .grid = &self.grid,
+        .cutoff_sq = cutoff * cutoff,
+    };
+}
+
+/// Neighbours for the short-range part of a P3M evaluation.
+const NearSources = struct {
+    sources: kernel.Sources,
+    grid: *const SpatialHash,
+    cutoff_sq: Real,
+};
+
+const MeshRows = struct {
+    mesh: *const ParticleMesh,
+    bodies: Bodies,
+    g: Real,
+    /// Set for P3M, whose mesh only carries the long range.
+    near: ?NearSources = null,
+
+    fn run(self: @This(), start: usize, end: usize) void {
+        for (start..end) |i| self.row(i);
+    }
+
+    fn row(self: @This(), i: usize) void {
+        const x = self.bodies.items(.x);
+        const y = self.bodies.items(.y);
+        var accel = self.mesh.accel(x[i], y[i]);
+        if (self.near) |near| {
+            const mass = self.bodies.items(.mass);
+            const buckets = near.grid.near(x[i], y[i]);
+            for (buckets.slice()) |bucket| {
+                for (near.grid.entriesOf(bucket)) |j| {
+                    const d = V2{ x[j] - x[i], y[j] - y[i] };
+                    const dist_sq = @reduce(.Add, d * d);
+                    if (j == i or dist_sq >= near.cutoff_sq) continue;
+                    const long = mass[j] * self.mesh.longRange(dist_sq);
+                    accel += precision.cast(V2, kernel.pairAccel(near.sources, i, j)) -
+                        d * @as(V2, @splat(long));
+                }
+            }
+        }
+        self.bodies.items(.ax)[i] = accel[0] * self.g;
+        self.bodies.items(.ay)[i] = accel[1] * self.g;
+    }
+};
+
+const MultipoleRows = struct {
+    multipole: *const FastMultipole,
+    sources: kernel.Sources,
+    bodies: Bodies,
+    g: Real,
+
+    fn run(self: @This(), start: usize, end: usize) void {
+        for (start..end) |i| self.row(i);
+    }
+
+    fn row(self: @This(), i: usize) void {
+        const accel = self.multipole.accel(self.sources, i);
+        self.bodies.items(.ax)[i] = accel[0] * self.g;
+        self.bodies.items(.ay)[i] = accel[1] * self.g;
+    }
+};
+
+fn gravitySources(self: @This()) kernel.Sources {
+    return .{
+        .x = self.bodies.items(.x),
+        .y = self.bodies.items(.y),
+        .mass = self.bodies.items(.mass),
+        .softening_sq = self.softening * self.softening,
+    };
+}
+
+/// Exact pairwise sum, visiting each pair once and applying the interaction
+/// to both bodies.
+fn computeInteractions(self: *@This()) void {
+    const bodies = self.bodies;
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const mass = bodies.items(.mass);
+    const softening_sq = self.softening * self.softening;
+    const ax = bodies.items(.ax);
+    const ay = bodies.items(.ay);
+
+    @memset(ax, 0);
+    @memset(ay, 0);
+
+    for (0..bodies.len) |i| {
+        var ax_i: Real = 0;
+        var ay_i: Real = 0;
+        for (i + 1..bodies.len) |j| {
+            const dx = x[i] - x[j];
+            const dy = y[i] - y[j];
+            const dist_sq = dx * dx + dy * dy + softening_sq;
+            const dist = @sqrt(dist_sq);
+
+            const factor = self.g / (dist_sq * dist);
+            ax_i -= dx * factor * mass[j];
+            ay_i -= dy * factor * mass[j];
+            ax[j] += dx * factor * mass[i];
+            ay[j] += dy * factor * mass[i];
+        }
+        ax[i] += ax_i;
+        ay[i] += ay_i;
+    }
+}
+
+/// Resolves contacts between bodies, then with the walls. Returns whether
+/// any body was moved or bounced.
+fn computeCollisions(self: *@This()) !bool {
+    const touched = try self.computeBodyCollisions();
+    const bounced = self.computeScreenCollision();
+    return touched or bounced;
+}
+
+/// Finds touching pairs through a spatial hash with cells as wide as the
+/// largest body, so each body only checks the 3x3 cells around its own, and
+/// resolves each pair in turn. Returns whether any pair touched.
+pub fn computeBodyCollisions(self: *@This()) !bool {
+    const bodies = self.bodies;
+    if (self.collisions == .none or bodies.len < 2) return false;
+
+    var max_radius: Real = 0;
+    for (bodies.items(.radius)) |radius| max_radius = @max(max_radius, radius);
+    const cell_size = 2 * max_radius * (1 + contact_slop);
+    try self.grid.build(bodies.items(.x), bodies.items(.y), cell_size);
+
+    return switch (self.collisions) {
+        .none => unreachable,
+        .elastic => self.bounceTouching(1),
+        .inelastic => self.bounceTouching(collision_dampen_factor),
+        .merge => try self.mergeTouching(),
+    };
+}
+
+fn bounceTouching(self: *@This(), restitution: Real) bool {
+    const bodies = self.bodies;
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    var touched = false;
+    for (0..bodies.len) |i| {
+        const near = self.grid.near(x[i], y[i]);
+        for (near.slice()) |bucket| {
+            for (self.grid.entriesOf(bucket)) |j| {
+                if (j <= i) continue;
+                if (resolveContact(bodies, i, j, restitution)) touched = true;
+            }
+        }
+    }
+    return touched;
+}
+
+/// Folds every body into the first body found touching it, then
+/// swap-removes the absorbed ones, highest index first so that each body
+/// moved into a hole has already been checked. A body that grows past its
+/// grid cell may miss a neighbour until the next step.
+fn mergeTouching(self: *@This()) !bool {
+    const bodies = self.bodies;
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const radius = bodies.items(.radius);
+
+    try self.absorbed.resize(self.allocator, bodies.len, false);
+    self.absorbed.unsetAll();
+
+    var merged = false;
+    for (0..bodies.len) |i| {
+        if (self.absorbed.isSet(i)) continue;
+        const near = self.grid.near(x[i], y[i]);
+        for (near.slice()) |bucket| {
+            for (self.grid.entriesOf(bucket)) |j| {
+                if (j <= i or self.absorbed.isSet(j)) continue;
+                const dx = x[j] - x[i];
+                const dy = y[j] - y[i];
+                const reach = (radius[i] + radius[j]) * (1 + contact_slop);
+                if (dx * dx + dy * dy >= reach * reach) continue;
+
+                absorb(bodies, i, j);
+                self.absorbed.set(j);
+                merged = true;
+            }
+        }
+    }
+    if (!merged) return false;
+
+    var i = bodies.len;
+    while (i > 0) {
+        i -= 1;
+        if (self.absorbed.isSet(i)) self.bodies.swapRemove(i);
+    }
+    self.accelerations_stale = true;
+    return true;
+}
+
+/// Merges body `j` into body `i` at their centre of mass, keeping the total
+/// mass and momentum, and the total area so merged bodies do not shrink.
+fn absorb(bodies: Bodies, i: usize, j: usize) void {
+    const mass = bodies.items(.mass);
+    const radius = bodies.items(.radius);
+    const total = mass[i] + mass[j];
+    const weight_i = mass[i] / total;
+    const weight_j = mass[j] / total;
+
+    inline for (.{ .x, .y, .vx, .vy, .prev_x, .prev_y }) |field| {
+        const values = bodies.items(field);
+        values[i] = values[i] * weight_i + values[j] * weight_j;
+    }
+    radius[i] = @sqrt(radius[i] * radius[i] + radius[j] * radius[j]);
+    mass[i] = total;
+}
+
+/// Separates bodies `i` and `j` if they overlap, each moving in proportion
+/// to the other's mass, and exchanges an impulse along the contact normal if
+/// they are approaching. Returns whether they overlapped.
+fn resolveContact(bodies: Bodies, i: usize, j: usize, restitution: Real) bool {
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    const vx = bodies.items(.vx);
+    const vy = bodies.items(.vy);
+    const mass = bodies.items(.mass);
+    const radius = bodies.items(.radius);
+
+    const d = V2{ x[j] - x[i], y[j] - y[i] };
+    const dist_sq = d[0] * d[0] + d[1] * d[1];
+    const contact = radius[i] + radius[j];
+    const reach = contact * (1 + contact_slop);
+    if (dist_sq >= reach * reach) return false;
+
+    const dist = @sqrt(dist_sq);
+    const normal = if (dist > 0) d / @as(V2, @splat(dist)) else V2{ 1, 0 };
+    const inv_mass_i = 1 / mass[i];
+    const inv_mass_j = 1 / mass[j];
+    const inv_mass_sum = inv_mass_i + inv_mass_j;
+
+    const overlap = @max(contact - dist, 0);
+    const push = normal * @as(V2, @splat(overlap / inv_mass_sum));
+    x[i] -= push[0] * inv_mass_i;
+    y[i] -= push[1] * inv_mass_i;
+    x[j] += push[0] * inv_mass_j;
+    y[j] += push[1] * inv_mass_j;
+
+    const approach = (vx[j] - vx[i]) * normal[0] + (vy[j] - vy[i]) * normal[1];
+    if (approach < 0) {
+        const impulse = normal * @as(V2, @splat(-(1 + restitution) * approach / inv_mass_sum));
+        vx[i] -= impulse[0] * inv_mass_i;
+        vy[i] -= impulse[1] * inv_mass_i;
+        vx[j] += impulse[0] * inv_mass_j;
+        vy[j] += impulse[1] * inv_mass_j;
+    }
+    return true;
+}
+
+/// Bounces bodies off the edges of the world. Returns whether any did.
+fn computeScreenCollision(self: *@This()) bool {
+    const bodies = self.bodies;
+    const radius = bodies.items(.radius);
+    const bounced_x = collideAxis(bodies.items(.x), bodies.items(.vx), radius, self.bounds[0]);
+    const bounced_y = collideAxis(bodies.items(.y), bodies.items(.vy), radius, self.bounds[1]);
+    return bounced_x or bounced_y;
+}
+
+fn collideAxis(pos: []Real, velocity: []Real, radius: []const Real, bound: Real) bool {
+    var bounced = false;
+    for (pos, velocity, radius) |*p, *v, r| {
+        // Only bounce bodies still heading out, so one already turned
+        // around by a sweep is not sent back into the wall.
+        if (p.* - r < 0) {
+            p.* = r;
+            if (v.* >= 0) continue;
+        } else if (p.* + r > bound) {
+            p.* = bound - r;
+            if (v.* <= 0) continue;
+        } else continue;
+        v.* *= -collision_dampen_factor;
+        bounced = true;
+    }
+    return bounced;
+}
+
+test "merging conserves mass, momentum and area and retires absorbed IDs" {
+    var sim = init(.{ .allocator = std.testing.allocator, .collisions = .merge });
+    defer sim.deinit();
+    // Bodies 1 and 2 both touch body 0; body 3 is far from all of them.
+    try sim.add(.{ .mass = 1, .radius = 0.01, .pos = .{ 0.5, 0.5 }, .velocity = .{ 1, 0 } });
+    try sim.add(.{ .mass = 2, .radius = 0.01, .pos = .{ 0.51, 0.5 }, .velocity = .{ 0, 1 } });
+    try sim.add(.{ .mass = 3, .radius = 0.01, .pos = .{ 0.5, 0.51 }, .velocity = .{ -1, -1 } });
+    try sim.add(.{ .mass = 5, .radius = 0.02, .pos = .{ 1.2, 0.8 }, .velocity = .{ 0, 0.5 } });
+    const bodies = sim.bodies;
+    const ids = [_]Bodies.Id{ bodies.id(0), bodies.id(1), bodies.id(2), bodies.id(3) };
+
+    var centre = V2{ 0, 0 };
+    var momentum = V2{ 0, 0 };
+    var area: Real = 0;
+    for (0..3) |i| {
+        const body = bodies.get(i);
+        centre += body.pos * @as(V2, @splat(body.mass / 6));
+        momentum += body.velocity * @as(V2, @splat(body.mass));
+        area += body.radius * body.radius;
+    }
+
+    try std.testing.expect(try sim.computeBodyCollisions());
+    try std.testing.expectEqual(@as(usize, 2), sim.bodies.len);
+    try std.testing.expectEqual(@as(?usize, null), sim.bodies.indexOf(ids[1]));
+    try std.testing.expectEqual(@as(?usize, null), sim.bodies.indexOf(ids[2]));
+    const survivor = sim.bodies.get(sim.bodies.indexOf(ids[0]).?);
+    const other = sim.bodies.get(sim.bodies.indexOf(ids[3]).?);
+
+    const tolerance = 1e-6;
+    try std.testing.expectApproxEqAbs(@as(Real, 6), survivor.mass, tolerance);
+    try std.testing.expectApproxEqAbs(area, survivor.radius * survivor.radius, tolerance);
+    const survivor_momentum = survivor.velocity * @as(V2, @splat(survivor.mass));
+    inline for (0..2) |axis| {
+        try std.testing.expectApproxEqAbs(centre[axis], survivor.pos[axis], tolerance);
+        try std.testing.expectApproxEqAbs(momentum[axis], survivor_momentum[axis], tolerance);
+    }
+    try std.testing.expectEqual(@as(Real, 5), other.mass);
+    try std.testing.expectEqual(V2{ 1.2, 0.8 }, other.pos);
+}
+
+/// A close pair on a circular orbit, which block steps put four levels
+/// down, and a distant body they leave at level 0. Units with g = 1.
+fn testTriple(integrator: Integrator) !@This() {
+    var sim = init(.{
+        .allocator = std.testing.allocator,
+        .integrator = integrator,
+        .g = 1,
+        .dt = 1e-3,
+        .softening = 1e-3,
+    });
+    errdefer sim.deinit();
+    try sim.add(.{ .mass = 1, .radius = 1e-3, .pos = .{ 0.49, 0.5 }, .velocity = .{ 0, -5 } });
+    try sim.add(.{ .mass = 1, .radius = 1e-3, .pos = .{ 0.51, 0.5 }, .velocity = .{ 0, 5 } });
+    try sim.add(.{ .mass = 1, .radius = 1e-3, .pos = .{ 1, 0.5 } });
+    return sim;
+}
+
+/// Largest change in energy over `steps` steps.
+fn testEnergyDrift(sim: *@This(), steps: usize) !f64 {
+    const initial = sim.energy();
+    var worst: f64 = 0;
+    for (0..steps) |_| {
+        try sim.step();
+        worst = @max(worst, @abs(sim.energy() - initial));
+    }
+    return worst;
+}
+
+test "block steps end together and hold energy better than one level" {
+    var block = try testTriple(.block);
+    defer block.deinit();
+    // One step alone must end with every body on the last tick, which
+    // blockStep asserts, and with the forces fresh at the synced positions.
+    try block.step();
+    try std.testing.expect(!block.accelerations_stale);
+    const level = block.bodies.items(.level);
+    try std.testing.expect(level[0] >= 1 and level[1] >= 1);
+    try std.testing.expectEqual(@as(Real, 0), level[2]);
+    for (0..block.bodies.len) |i| {
+        const fresh = kernel.accelScalar(block.gravitySources(), i) * @as(V2, @splat(block.g));
+        const stored = V2{ block.bodies.items(.ax)[i], block.bodies.items(.ay)[i] };
+        const diff = fresh - stored;
+        try std.testing.expect(@reduce(.Add, diff * diff) <= 1e-8 * @reduce(.Add, fresh * fresh));
+    }
+
+    var single = try testTriple(.leapfrog);
+    defer single.deinit();
+    const steps = 20;
+    const block_drift = try testEnergyDrift(&block, steps);
+    const single_drift = try testEnergyDrift(&single, steps);
+    try std.testing.expect(block_drift < single_drift);
+}
@@ -0,0 +1,233 @@
+const Sim = @import("Sim.zig");
+const precision = @import("precision.zig");
+const savestate = @import("savestate.zig");
+const std = @import("std");
+
+const Body = Sim.Body;
+const BodyId = Sim.Bodies.Id;
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+allocator: std.mem.Allocator,
+sim: Sim,
+thread: std.Thread = undefined,
+running: std.atomic.Value(bool) = std.atomic.Value(bool).init(true),
+start: std.time.Instant,
+commands: CommandQueue = .{},
+/// Body picked with `.select`. Held by ID, since its index changes whenever
+/// bodies are removed or reordered.
+selected: ?BodyId = null,
+snapshots: [3]Snapshot = .{ .{}, .{}, .{} },
+/// Index of the snapshot handed between the threads, plus `fresh_bit` when
+/// the simulation has published into it since the renderer last took it.
+shared: std.atomic.Value(u8) = std.atomic.Value(u8).init(1),
+back: u8 = 0,
+front: u8 = 2,
+
+const fresh_bit = 4;
+
+/// Requests from the render thread, applied before the next step.
+pub const Command = union(enum) {
+    add: Body,
+    clear,
+    bounds: V2,
+    /// Selects the body under a point, or clears the selection if there is
+    /// none.
+    select: V2,
+    save: []const u8,
+    load: []const u8,
+};
+
+/// Immutable copy of the state needed to draw one simulation step, in f32
+/// whatever the simulation's precision, since that is what gets drawn.
+pub const Snapshot = struct {
+    x: std.ArrayListUnmanaged(f32) = .{},
+    y: std.ArrayListUnmanaged(f32) = .{},
+    prev_x: std.ArrayListUnmanaged(f32) = .{},
+    prev_y: std.ArrayListUnmanaged(f32) = .{},
+    radius: std.ArrayListUnmanaged(f32) = .{},
+    /// Index of the selected body in this snapshot.
+    selected: ?usize = null,
+    published_ns: u64 = 0,
+    accumulator: f32 = 0,
+    dt: f32 = 1,
+
+    pub inline fn len(self: @This()) usize {
+        return self.x.items.len;
+    }
+
+    pub inline fn interpolatedPos(self: @This(), i: usize, t: f32) @Vector(2, f32) {
+        const prev = @Vector(2, f32){ self.prev_x.items[i], self.prev_y.items[i] };
+        const pos = @Vector(2, f32){ self.x.items[i], self.y.items[i] };
+        return prev + (pos - prev) * @as(@Vector(2, f32), @splat(t));
+    }
+
+    fn deinit(self: *@This(), allocator: std.mem.Allocator) void {
+        self.x.deinit(allocator);
+        self.y.deinit(allocator);
+        self.prev_x.deinit(allocator);
+        self.prev_y.deinit(allocator);
+        self.radius.deinit(allocator);
+    }
+};
+
+/// Single-producer single-consumer ring of commands. Pushing never blocks;
+/// a full queue drops the command.
+const CommandQueue = struct {
+    buffer: [capacity]Command = undefined,
+    head: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+    tail: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+
+    const capacity = 256;
+
+    fn push(self: *@This(), command: Command) bool {
+        const tail = self.tail.load(.monotonic);
+        if (tail -% self.head.load(.acquire) == capacity) return false;
+        self.buffer[tail % capacity] = command;
+        self.tail.store(tail +% 1, .release);
+        return true;
+    }
+
+    fn pop(self: *@This()) ?Command {
+        const head = self.head.load(.monotonic);
+        if (head == self.tail.load(.acquire)) return null;
+        const command = self.buffer[head % capacity];
+        self.head.store(head +% 1, .release);
+        return command;
+    }
+};
+
+/// Takes ownership of `sim` and starts stepping it in real time on a new
+/// thread.
+pub fn spawn(allocator: std.mem.Allocator, sim: Sim) !*@This() {
+    const self = try allocator.create(@This());
+    errdefer allocator.destroy(self);
+    self.* = .{
+        .allocator = allocator,
+        .sim = sim,
+        .start = try std.time.Instant.now(),
+    };
+    self.thread = try std.Thread.spawn(.{}, run, .{self});
+    return self;
+}
+
+pub fn destroy(self: *@This()) void {
+    self.running.store(false, .release);
+    self.thread.join();
+
+    self.sim.deinit();
+    for (&self.snapshots) |*snapshot| snapshot.deinit(self.allocator);
+    self.allocator.destroy(self);
+}
+
+pub fn send(self: *@This(), command: Command) void {
+    if (!self.commands.push(command)) {
+        std.log.warn("simulation command queue full, dropping {s}", .{@tagName(command)});
+    }
+}
+
+/// The most recently published snapshot. It stays valid until the next call.
+pub fn latest(self: *@This()) *const Snapshot {
+    if (self.shared.load(.acquire) & fresh_bit != 0) {
+        self.front = self.shared.swap(self.front, .acq_rel) & ~@as(u8, fresh_bit);
+    }
+    return &self.snapshots[self.front];
+}
+
+/// How far between the previous and current positions of `snapshot` the
+/// renderer should draw, given the time since it was published.
+pub fn alpha(self: *const @This(), snapshot: *const Snapshot) f32 {
+    const elapsed_ns: f32 = @floatFromInt(self.nanoseconds() -| snapshot.published_ns);
+    const t = snapshot.accumulator + elapsed_ns / std.time.ns_per_s;
+    return std.math.clamp(t / snapshot.dt, 0, 1);
+}
+
+inline fn nanoseconds(self: *const @This()) u64 {
+    const now = std.time.Instant.now() catch return 0;
+    return now.since(self.start);
+}
+
+fn run(self: *@This()) void {
+    var last_ns = self.nanoseconds();
+    while (self.running.load(.acquire)) {
+        while (self.commands.pop()) |command| {
+            self.apply(command) catch |err| {
+                std.log.err("simulation command failed: {s}", .{@errorName(err)});
+            };
+        }
+
+        const now_ns = self.nanoseconds();
+        const frame_ns: f32 = @floatFromInt(now_ns -| last_ns);
+        last_ns = now_ns;
+
+        self.sim.advance(frame_ns / std.time.ns_per_s) catch |err| {
+            std.log.err("simulation step failed: {s}", .{@errorName(err)});
+        };
+        self.publish(now_ns) catch |err| {
+            std.log.err("snapshot failed: {s}", .{@errorName(err)});
+        };
+
+        const until_next_step = self.sim.dt - self.sim.accumulator;
+        if (until_next_step > 0) {
+            std.time.sleep(@intFromFloat(until_next_step * std.time.ns_per_s));
+        }
+    }
+}
+
+fn apply(self: *@This(), command: Command) !void {
+    switch (command) {
+        .add => |body| try self.sim.add(body),
+        .clear => self.sim.clear(),
+        .bounds => |bounds| self.sim.bounds = bounds,
+        .select => |pos| self.selected = self.bodyAt(pos),
+        .save => |path| try savestate.save(&self.sim, path),
+        .load => |path| try savestate.load(&self.sim, path),
+    }
+}
+
+/// ID of the body whose disc holds `pos`, the nearest if several do.
+fn bodyAt(self: *@This(), pos: V2) ?BodyId {
+    const bodies = self.sim.bodies;
+    var nearest: ?usize = null;
+    var nearest_dist_sq = std.math.inf(Real);
+    for (bodies.items(.x), bodies.items(.y), bodies.items(.radius), 0..) |x, y, radius, i| {
+        const offset = V2{ x, y } - pos;
+        const dist_sq = @reduce(.Add, offset * offset);
+        if (dist_sq <= radius * radius and dist_sq < nearest_dist_sq) {
+            nearest = i;
+            nearest_dist_sq = dist_sq;
+        }
+    }
+    return if (nearest) |i| bodies.id(i) else null;
+}
+
+fn publish(self: *@This(), now_ns: u64) !void {
+    const snapshot = &self.snapshots[self.back];
+    const bodies = self.sim.bodies;
+    try copyInto(self.allocator, &snapshot.x, bodies.items(.x));
+    try copyInto(self.allocator, &snapshot.y, bodies.items(.y));
+    try copyInto(self.allocator, &snapshot.prev_x, bodies.items(.prev_x));
+    try copyInto(self.allocator, &snapshot.prev_y, bodies.items(.prev_y));
+    try copyInto(self.allocator, &snapshot.radius, bodies.items(.radius));
+    snapshot.selected = if (self.selected) |id| bodies.indexOf(id) else null;
+    // The body may have merged or been cleared; forget it then.
+    if (snapshot.selected == null) self.selected = null;
+    snapshot.published_ns = now_ns;
+    snapshot.accumulator = precision.cast(f32, self.sim.accumulator);
+    snapshot.dt = precision.cast(f32, self.sim.dt);
+
+    self.back = self.shared.swap(self.back | fresh_bit, .acq_rel) & ~@as(u8, fresh_bit);
+}
+
+fn copyInto(
+    allocator: std.mem.Allocator,
+    list: *std.ArrayListUnmanaged(f32),
+    values: []const Real,
+) !void {
+    try list.resize(allocator, values.len);
+    if (Real == f32) {
+        @memcpy(list.items, values);
+    } else {
+        for (list.items, values) |*item, value| item.* = precision.cast(f32, value);
+    }
+}
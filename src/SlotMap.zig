@@ -0,0 +1,97 @@
+const std = @import("std");
+
+/// Slot of each ID and the body index it points at. A slot is live while its
+/// generation is odd; a free slot's `index` links to the next free slot.
+slots: std.ArrayListUnmanaged(Slot) = .{},
+/// Most recently freed slot, reused first.
+free_head: u32 = none,
+
+const none = std.math.maxInt(u32);
+
+/// Handle to one body. The generation tells a body apart from later ones
+/// that reuse its slot, so a stale ID never finds the wrong body.
+pub const Id = packed struct(u64) {
+    slot: u32,
+    generation: u32,
+};
+
+const Slot = struct {
+    index: u32,
+    generation: u32 = 0,
+};
+
+pub fn deinit(self: *@This(), allocator: std.mem.Allocator) void {
+    self.slots.deinit(allocator);
+    self.* = .{};
+}
+
+/// Makes sure `count` more IDs can be inserted without allocating.
+pub fn ensureUnusedCapacity(self: *@This(), allocator: std.mem.Allocator, count: usize) !void {
+    try self.slots.ensureUnusedCapacity(allocator, count);
+}
+
+/// Returns a new ID pointing at `index`, reusing a free slot if there is
+/// one. O(1).
+pub fn insertAssumeCapacity(self: *@This(), index: u32) Id {
+    const slot_index = if (self.free_head != none) reused: {
+        const reused = self.free_head;
+        self.free_head = self.slots.items[reused].index;
+        break :reused reused;
+    } else appended: {
+        self.slots.appendAssumeCapacity(.{ .index = none });
+        break :appended @as(u32, @intCast(self.slots.items.len - 1));
+    };
+
+    const slot = &self.slots.items[slot_index];
+    slot.generation +%= 1;
+    slot.index = index;
+    return .{ .slot = slot_index, .generation = slot.generation };
+}
+
+/// Invalidates `id` and frees its slot. O(1).
+pub fn remove(self: *@This(), id: Id) void {
+    const slot = &self.slots.items[id.slot];
+    std.debug.assert(slot.generation == id.generation);
+    slot.generation +%= 1;
+    slot.index = self.free_head;
+    self.free_head = id.slot;
+}
+
+/// Points `id` at a new index. O(1).
+pub inline fn move(self: @This(), id: Id, index: u32) void {
+    std.debug.assert(self.slots.items[id.slot].generation == id.generation);
+    self.slots.items[id.slot].index = index;
+}
+
+/// Index `id` points at, or null if it has been removed. O(1).
+pub fn get(self: @This(), id: Id) ?u32 {
+    if (id.slot >= self.slots.items.len) return null;
+    const slot = self.slots.items[id.slot];
+    return if (slot.generation == id.generation) slot.index else null;
+}
+
+test "IDs find their index until removed, and stale IDs never resolve" {
+    const allocator = std.testing.allocator;
+    var map: @This() = .{};
+    defer map.deinit(allocator);
+    try map.ensureUnusedCapacity(allocator, 3);
+
+    const a = map.insertAssumeCapacity(0);
+    const b = map.insertAssumeCapacity(1);
+    try std.testing.expectEqual(@as(?u32, 0), map.get(a));
+    try std.testing.expectEqual(@as(?u32, 1), map.get(b));
+
+    map.move(b, 5);
+    try std.testing.expectEqual(@as(?u32, 5), map.get(b));
+
+    map.remove(a);
+    try std.testing.expectEqual(@as(?u32, null), map.get(a));
+
+    // The freed slot is reused under a new generation.
+    const c = map.insertAssumeCapacity(2);
+    try std.testing.expectEqual(a.slot, c.slot);
+    try std.testing.expect(c.generation != a.generation);
+    try std.testing.expectEqual(@as(?u32, null), map.get(a));
+    try std.testing.expectEqual(@as(?u32, 2), map.get(c));
+    try std.testing.expectEqual(@as(usize, 2), map.slots.items.len);
+}
@@ -0,0 +1,218 @@
+const Sim = @import("Sim.zig");
+const std = @import("std");
+
+const Real = Sim.Real;
+
+/// First index in `entries` of each bucket, plus one final entry holding the
+/// total, so bucket `b` owns `entries[starts[b]..starts[b + 1]]`.
+starts: std.ArrayList(u32),
+/// Point indices grouped by bucket, ascending within each bucket.
+entries: std.ArrayList(u32),
+/// Bucket of each point, kept between the counting and scattering passes.
+buckets: std.ArrayList(u32),
+cell_size: Real = 1,
+mask: u32 = 0,
+
+/// Up to nine distinct buckets covering the cells around a point.
+pub const Near = struct {
+    buckets: [9]u32 = undefined,
+    len: usize = 0,
+
+    pub fn slice(self: *const @This()) []const u32 {
+        return self.buckets[0..self.len];
+    }
+};
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{
+        .starts = std.ArrayList(u32).init(allocator),
+        .entries = std.ArrayList(u32).init(allocator),
+        .buckets = std.ArrayList(u32).init(allocator),
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    self.starts.deinit();
+    self.entries.deinit();
+    self.buckets.deinit();
+}
+
+/// Hashes every point into a square cell of `cell_size` and counting-sorts
+/// the points by bucket. There are as many buckets as points, rounded up to
+/// a power of two, so the build is O(n) wherever the points are.
+pub fn build(self: *@This(), x: []const Real, y: []const Real, cell_size: Real) !void {
+    const bucket_count = try std.math.ceilPowerOfTwo(usize, @max(x.len, 1));
+    self.cell_size = cell_size;
+    self.mask = @intCast(bucket_count - 1);
+
+    try self.starts.resize(bucket_count + 1);
+    try self.entries.resize(x.len);
+    try self.buckets.resize(x.len);
+    const starts = self.starts.items;
+
+    @memset(starts, 0);
+    for (x, y, self.buckets.items) |px, py, *bucket| {
+        bucket.* = self.bucketOf(self.cellOf(px), self.cellOf(py));
+        starts[bucket.*] += 1;
+    }
+    for (1..bucket_count) |b| starts[b] += starts[b - 1];
+
+    // Walking backwards turns each running total into the bucket's start
+    // while keeping the points in ascending order within it.
+    var i = x.len;
+    while (i > 0) {
+        i -= 1;
+        const bucket = self.buckets.items[i];
+        starts[bucket] -= 1;
+        self.entries.items[starts[bucket]] = @intCast(i);
+    }
+    starts[bucket_count] = @intCast(x.len);
+}
+
+/// Like `build`, but for points moving by `dx`/`dy` times `scale`: each one
+/// is entered in every cell its path crosses, and a point can appear in a
+/// bucket more than once. Paths as long as the cells are wide, or shorter,
+/// cross at most three cells, so pick `cell_size` to keep the entry count
+/// near `x.len`; the count must fit a `u32`.
+pub fn buildSwept(
+    self: *@This(),
+    x: []const Real,
+    y: []const Real,
+    dx: []const Real,
+    dy: []const Real,
+    scale: Real,
+    cell_size: Real,
+) !void {
+    const bucket_count = try std.math.ceilPowerOfTwo(usize, @max(x.len, 1));
+    self.cell_size = cell_size;
+    self.mask = @intCast(bucket_count - 1);
+
+    try self.starts.resize(bucket_count + 1);
+    const starts = self.starts.items;
+
+    @memset(starts, 0);
+    var total: usize = 0;
+    for (0..x.len) |i| {
+        var cells = self.path(x[i], y[i], dx[i] * scale, dy[i] * scale);
+        while (cells.next()) |cell| {
+            starts[self.bucketOf(cell[0], cell[1])] += 1;
+            total += 1;
+        }
+    }
+    if (total > std.math.maxInt(u32)) return error.Overflow;
+    for (1..bucket_count) |b| starts[b] += starts[b - 1];
+
+    try self.entries.resize(total);
+    var i = x.len;
+    while (i > 0) {
+        i -= 1;
+        var cells = self.path(x[i], y[i], dx[i] * scale, dy[i] * scale);
+        while (cells.next()) |cell| {
+            const bucket = self.bucketOf(cell[0], cell[1]);
+            starts[bucket] -= 1;
+            self.entries.items[starts[bucket]] = @intCast(i);
+        }
+    }
+    starts[bucket_count] = @intCast(total);
+}
+
+/// The cells crossed by the segment from (px, py) to (px + dx, py + dy),
+/// from its start to its end, each sharing an edge with the one before.
+pub fn path(self: @This(), px: Real, py: Real, dx: Real, dy: Real) Path {
+    const start_x = self.cellOf(px);
+    const start_y = self.cellOf(py);
+    const end_x = self.cellOf(px + dx);
+    const end_y = self.cellOf(py + dy);
+    return .{
+        .cx = start_x,
+        .cy = start_y,
+        .step_x = if (end_x < start_x) -1 else 1,
+        .step_y = if (end_y < start_y) -1 else 1,
+        .remaining_x = @abs(end_x - start_x),
+        .remaining_y = @abs(end_y - start_y),
+        .next_x = crossing(px, dx, self.cell_size, start_x),
+        .next_y = crossing(py, dy, self.cell_size, start_y),
+        .delta_x = if (dx == 0) std.math.inf(Real) else self.cell_size / @abs(dx),
+        .delta_y = if (dy == 0) std.math.inf(Real) else self.cell_size / @abs(dy),
+    };
+}
+
+/// Fraction of the way along a move of `d` from `p` at which it leaves
+/// `cell`, or infinity if it never does.
+fn crossing(p: Real, d: Real, cell_size: Real, cell: i32) Real {
+    if (d == 0) return std.math.inf(Real);
+    const side: Real = @floatFromInt(if (d > 0) cell + 1 else cell);
+    return (side * cell_size - p) / d;
+}
+
+/// Walks the cells of a segment one at a time, stepping into whichever
+/// neighbour the segment enters first. The steps are counted out from the
+/// end cell, so rounding can never make the walk overshoot or stop early.
+pub const Path = struct {
+    cx: i32,
+    cy: i32,
+    step_x: i32,
+    step_y: i32,
+    remaining_x: u32,
+    remaining_y: u32,
+    next_x: Real,
+    next_y: Real,
+    delta_x: Real,
+    delta_y: Real,
+    done: bool = false,
+
+    pub fn next(self: *Path) ?[2]i32 {
+        if (self.done) return null;
+        const cell = [2]i32{ self.cx, self.cy };
+        const step_x = self.remaining_x > 0 and
+            (self.remaining_y == 0 or self.next_x < self.next_y);
+        if (step_x) {
+            self.cx +%= self.step_x;
+            self.next_x += self.delta_x;
+            self.remaining_x -= 1;
+        } else if (self.remaining_y > 0) {
+            self.cy +%= self.step_y;
+            self.next_y += self.delta_y;
+            self.remaining_y -= 1;
+        } else {
+            self.done = true;
+        }
+        return cell;
+    }
+};
+
+/// The points hashed into `bucket`. Points from other cells may share it.
+pub inline fn entriesOf(self: @This(), bucket: u32) []const u32 {
+    return self.entries.items[self.starts.items[bucket]..self.starts.items[bucket + 1]];
+}
+
+/// The distinct buckets of the 3x3 cells centred on the cell holding
+/// (px, py). Any point within `cell_size` of it is in one of them.
+pub fn near(self: @This(), px: Real, py: Real) Near {
+    return self.nearCell(self.cellOf(px), self.cellOf(py));
+}
+
+/// The distinct buckets of the 3x3 cells centred on cell (cx, cy).
+pub fn nearCell(self: @This(), cx: i32, cy: i32) Near {
+    var result = Near{};
+    for ([_]i32{ -1, 0, 1 }) |dy| {
+        for ([_]i32{ -1, 0, 1 }) |dx| {
+            const bucket = self.bucketOf(cx +% dx, cy +% dy);
+            if (std.mem.indexOfScalar(u32, result.slice(), bucket) != null) continue;
+            result.buckets[result.len] = bucket;
+            result.len += 1;
+        }
+    }
+    return result;
+}
+
+inline fn cellOf(self: @This(), p: Real) i32 {
+    const cell = @floor(std.math.clamp(p / self.cell_size, -1e9, 1e9));
+    return @intFromFloat(cell);
+}
+
+pub inline fn bucketOf(self: @This(), cx: i32, cy: i32) u32 {
+    const hx: u32 = @bitCast(cx);
+    const hy: u32 = @bitCast(cy);
+    return ((hx *% 73856093) ^ (hy *% 19349663)) & self.mask;
+}
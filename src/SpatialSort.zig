@@ -0,0 +1,62 @@
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const morton = @import("morton.zig");
+const std = @import("std");
+
+const Bodies = Sim.Bodies;
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+order: std.ArrayList(u32),
+keys: std.ArrayList(morton.Key),
+scratch_keys: std.ArrayList(morton.Key),
+scratch: std.ArrayList(u32),
+/// One field of the bodies, or their IDs, while they are permuted.
+scratch_values: std.ArrayList(u64),
+
+pub const Curve = morton.Curve;
+
+pub fn init(allocator: std.mem.Allocator) @This() {
+    return .{
+        .order = std.ArrayList(u32).init(allocator),
+        .keys = std.ArrayList(morton.Key).init(allocator),
+        .scratch_keys = std.ArrayList(morton.Key).init(allocator),
+        .scratch = std.ArrayList(u32).init(allocator),
+        .scratch_values = std.ArrayList(u64).init(allocator),
+    };
+}
+
+pub fn deinit(self: *@This()) void {
+    self.order.deinit();
+    self.keys.deinit();
+    self.scratch_keys.deinit();
+    self.scratch.deinit();
+    self.scratch_values.deinit();
+}
+
+/// Reorders `bodies` along `curve` through their bounding square, so bodies
+/// close in space are close in memory. IDs move with their bodies.
+pub fn sort(self: *@This(), bodies: Bodies, curve: Curve, pool: ?*Pool) !void {
+    if (bodies.len == 0) return;
+    try self.order.resize(bodies.len);
+    try self.keys.resize(bodies.len);
+    try self.scratch_keys.resize(bodies.len);
+    try self.scratch.resize(bodies.len);
+    try self.scratch_values.resize(bodies.len);
+    for (self.order.items, 0..) |*index, i| index.* = @intCast(i);
+
+    const x = bodies.items(.x);
+    const y = bodies.items(.y);
+    var min = V2{ x[0], y[0] };
+    var max = min;
+    for (x[1..], y[1..]) |body_x, body_y| {
+        min = @min(min, V2{ body_x, body_y });
+        max = @max(max, V2{ body_x, body_y });
+    }
+    const extent = max - min;
+    const size = @max(extent[0], extent[1], 1e-6) * 1.001;
+
+    morton.computeKeys(x, y, min, size, curve, self.keys.items, pool);
+    morton.sort(self.keys.items, self.order.items, self.scratch_keys.items, self.scratch.items, pool);
+    bodies.permute(self.order.items, self.scratch_values.items, pool);
+}
@@ -0,0 +1,62 @@
+const builtin = @import("builtin");
+const std = @import("std");
+
+const windows = std.os.windows;
+const page_size = std.mem.page_size;
+
+/// A reserved range of address space. Reserving costs no memory; pages are
+/// only backed once committed, and never move, so whatever lives in them
+/// can grow in place without being copied.
+bytes: []align(page_size) u8,
+
+/// Reserves `len` bytes, rounded up to whole pages, with nothing committed.
+pub fn reserve(len: usize) !@This() {
+    const size = std.mem.alignForward(usize, len, page_size);
+    if (builtin.os.tag == .windows) {
+        const address = try windows.VirtualAlloc(
+            null,
+            size,
+            windows.MEM_RESERVE,
+            windows.PAGE_NOACCESS,
+        );
+        const base: [*]align(page_size) u8 = @ptrCast(@alignCast(address));
+        return .{ .bytes = base[0..size] };
+    }
+    const bytes = try std.posix.mmap(
+        null,
+        size,
+        std.posix.PROT.NONE,
+        .{ .TYPE = .PRIVATE, .ANONYMOUS = true },
+        -1,
+        0,
+    );
+    return .{ .bytes = bytes };
+}
+
+/// Gives back the whole range, committed or not.
+pub fn release(self: @This()) void {
+    if (builtin.os.tag == .windows) {
+        windows.VirtualFree(self.bytes.ptr, 0, windows.MEM_RELEASE);
+    } else {
+        std.posix.munmap(self.bytes);
+    }
+}
+
+/// Backs `bytes[start..end]`, widened to whole pages, with readable and
+/// writable memory. Committing pages that already are is harmless.
+pub fn commit(self: @This(), start: usize, end: usize) !void {
+    const first = std.mem.alignBackward(usize, start, page_size);
+    const last = @min(std.mem.alignForward(usize, end, page_size), self.bytes.len);
+    if (first >= last) return;
+    const pages: []align(page_size) u8 = @alignCast(self.bytes[first..last]);
+    if (builtin.os.tag == .windows) {
+        _ = try windows.VirtualAlloc(
+            pages.ptr,
+            pages.len,
+            windows.MEM_COMMIT,
+            windows.PAGE_READWRITE,
+        );
+    } else {
+        try std.posix.mprotect(pages, std.posix.PROT.READ | std.posix.PROT.WRITE);
+    }
+}
@@ -0,0 +1,700 @@
+const Args = @import("Args.zig");
+const FastMultipole = @import("FastMultipole.zig");
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const kernel = @import("kernel.zig");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+pub const Benchmark = enum {
+    /// Vectorized direct sum against the scalar reference as n grows.
+    direct,
+    /// Barnes-Hut cost and error against the direct sum for a range of theta.
+    theta,
+    /// Direct-sum scaling with the number of pool threads.
+    threads,
+    /// Quadtree build scaling with the number of pool threads, and
+    /// Barnes-Hut traversal before and after sorting the bodies.
+    tree,
+    /// Energy drift of each integrator on the disc scene as the step grows,
+    /// and the cost of reaching a fixed energy error with each.
+    integrators,
+    /// Block timesteps against leapfrog at the block integrator's shortest
+    /// step, on collapsing clusters.
+    block,
+    /// Spatial hash collision pass as n grows at constant density.
+    collisions,
+    /// Tree traversal and collision pass with the bodies in spawn order and
+    /// after reordering them along each curve.
+    reorder,
+    /// Particle-mesh and P3M error against the direct sum for a range of mesh
+    /// sizes, and their scaling with n against Barnes-Hut.
+    mesh,
+    /// Fast multipole error against the direct sum for each expansion order,
+    /// and its scaling with n against Barnes-Hut.
+    fmm,
+    /// Throughput and accuracy of the precision this build was made with.
+    /// Build with each `-Dprecision` to compare them.
+    precision,
+};
+
+const default_bodies = 10_000;
+const default_orbiting_bodies = 200;
+const default_cluster_bodies = 1_000;
+const default_tree_bodies = 1_000_000;
+
+pub fn run(allocator: std.mem.Allocator, args: Args, benchmark: Benchmark) !void {
+    const stdout = std.io.getStdOut().writer();
+    const body_count = if (args.bodies == 0) default_bodies else args.bodies;
+    switch (benchmark) {
+        .direct => try direct(allocator, stdout, args),
+        .theta => try theta(allocator, stdout, body_count, args),
+        .threads => try threads(allocator, stdout, body_count, args),
+        .tree => try tree(
+            allocator,
+            stdout,
+            if (args.bodies == 0) default_tree_bodies else args.bodies,
+            args,
+        ),
+        .integrators => try integrators(
+            allocator,
+            stdout,
+            if (args.bodies == 0) default_orbiting_bodies else args.bodies,
+            args,
+        ),
+        .collisions => try collisions(allocator, stdout, args),
+        .reorder => try reorder(
+            allocator,
+            stdout,
+            if (args.bodies == 0) default_tree_bodies else args.bodies,
+            args,
+        ),
+        .mesh => try mesh(allocator, stdout, body_count, args),
+        .fmm => try fmm(allocator, stdout, body_count, args),
+        .precision => try precisionMode(allocator, stdout, args),
+        .block => try block(
+            allocator,
+            stdout,
+            if (args.bodies == 0) default_cluster_bodies else args.bodies,
+            args,
+        ),
+    }
+}
+
+fn direct(allocator: std.mem.Allocator, writer: anytype, args: Args) !void {
+    try writer.print("{d}-lane {s} kernel against the scalar pairwise sum\n\n", .{
+        kernel.lanes,
+        @tagName(precision.mode),
+    });
+    try writer.print("bodies  scalar (ms)  simd (ms)  simd interactions/s  max rel err\n", .{});
+    for ([_]usize{ 1_000, 2_000, 4_000, 8_000, 16_000 }) |body_count| {
+        var sim = try initSim(args, .{ .allocator = allocator });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        sim.solver = .direct_scalar;
+        const scalar_ms = try timeAccelerations(&sim);
+        const reference_x = try allocator.dupe(Real, sim.bodies.items(.ax));
+        defer allocator.free(reference_x);
+        const reference_y = try allocator.dupe(Real, sim.bodies.items(.ay));
+        defer allocator.free(reference_y);
+
+        sim.solver = .direct;
+        const simd_ms = try timeAccelerations(&sim);
+        const err = compare(
+            reference_x,
+            reference_y,
+            sim.bodies.items(.ax),
+            sim.bodies.items(.ay),
+        );
+
+        const n: f64 = @floatFromInt(body_count);
+        try writer.print("{d:6}  {d:11.2}  {d:9.2}  {e:19.3}  {e:11.3}\n", .{
+            body_count,
+            scalar_ms,
+            simd_ms,
+            n * n / (simd_ms / std.time.ms_per_s),
+            err.max,
+        });
+    }
+}
+
+fn theta(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    var sim = try initSim(args, .{ .allocator = allocator });
+    defer sim.deinit();
+    try sim.spawnRandom(body_count, args.seed);
+    // Barnes-Hut leaves the bodies in tree order, so sort them before taking
+    // the reference.
+    sim.solver = .barnes_hut;
+    try sim.computeAccelerations();
+
+    sim.solver = .direct;
+    const direct_ms = try timeAccelerations(&sim);
+    const reference_x = try allocator.dupe(Real, sim.bodies.items(.ax));
+    defer allocator.free(reference_x);
+    const reference_y = try allocator.dupe(Real, sim.bodies.items(.ay));
+    defer allocator.free(reference_y);
+
+    try writer.print("{d} bodies, direct sum {d:.2} ms\n\n", .{ body_count, direct_ms });
+    try writer.print("theta  time (ms)  speedup  mean rel err  max rel err\n", .{});
+
+    sim.solver = .barnes_hut;
+    for ([_]f32{ 0.2, 0.3, 0.5, 0.7, 1.0, 1.5 }) |t| {
+        sim.theta = t;
+        const ms = try timeAccelerations(&sim);
+        const err = compare(
+            reference_x,
+            reference_y,
+            sim.bodies.items(.ax),
+            sim.bodies.items(.ay),
+        );
+        try writer.print("{d:5.2}  {d:9.2}  {d:6.1}x  {e:12.3}  {e:11.3}\n", .{
+            t,
+            ms,
+            direct_ms / ms,
+            err.mean,
+            err.max,
+        });
+    }
+}
+
+fn threads(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    var sim = try initSim(args, .{ .allocator = allocator });
+    defer sim.deinit();
+    try sim.spawnRandom(body_count, args.seed);
+    // This benchmark picks its own thread counts, starting from none.
+    sim.pool.?.destroy();
+    sim.pool = null;
+
+    const serial_ms = try timeAccelerations(&sim);
+    const reference_x = try allocator.dupe(Real, sim.bodies.items(.ax));
+    defer allocator.free(reference_x);
+
+    const cpu_count = try std.Thread.getCpuCount();
+    try writer.print("{d} bodies, {d} cpus\n\n", .{ body_count, cpu_count });
+    try writer.print("threads  time (ms)  speedup  efficiency  identical\n", .{});
+
+    var thread_count: usize = 1;
+    while (thread_count <= cpu_count) : (thread_count *= 2) {
+        sim.pool = try Pool.create(allocator, thread_count);
+        defer {
+            sim.pool.?.destroy();
+            sim.pool = null;
+        }
+
+        const ms = try timeAccelerations(&sim);
+        const speedup = serial_ms / ms;
+        const identical = std.mem.eql(Real, reference_x, sim.bodies.items(.ax));
+        try writer.print("{d:7}  {d:9.2}  {d:6.2}x  {d:9.0}%  {s}\n", .{
+            thread_count,
+            ms,
+            speedup,
+            100 * speedup / @as(f64, @floatFromInt(thread_count)),
+            if (identical) "yes" else "no",
+        });
+    }
+}
+
+fn tree(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    var sim = try initSim(args, .{ .allocator = allocator, .solver = .barnes_hut });
+    defer sim.deinit();
+    try sim.spawnRandom(body_count, args.seed);
+
+    const cpu_count = try std.Thread.getCpuCount();
+    try writer.print("{d} bodies, {d} cpus\n\n", .{ body_count, cpu_count });
+    try writer.print("threads  build (ms)  speedup\n", .{});
+
+    var serial_ms: f64 = 0;
+    var thread_count: usize = 1;
+    while (thread_count <= cpu_count) : (thread_count *= 2) {
+        const pool = try Pool.create(allocator, thread_count);
+        defer pool.destroy();
+
+        var timer = try std.time.Timer.start();
+        try sim.tree.build(sim.bodies, pool);
+        const elapsed_ns: f64 = @floatFromInt(timer.read());
+        const ms = elapsed_ns / std.time.ns_per_ms;
+        if (thread_count == 1) serial_ms = ms;
+        try writer.print("{d:7}  {d:10.2}  {d:6.2}x\n", .{ thread_count, ms, serial_ms / ms });
+    }
+
+    // A subset evaluation over every body traverses without sorting them.
+    const all = try allocator.alloc(u32, body_count);
+    defer allocator.free(all);
+    for (all, 0..) |*index, i| index.* = @intCast(i);
+
+    var timer = try std.time.Timer.start();
+    try sim.computeAccelerationsOf(all);
+    const spawn_order_ns: f64 = @floatFromInt(timer.read());
+    try sim.computeAccelerations();
+    timer.reset();
+    try sim.computeAccelerationsOf(all);
+    const tree_order_ns: f64 = @floatFromInt(timer.read());
+
+    try writer.print("\nbody order  traversal (ms)\n", .{});
+    try writer.print("spawn       {d:14.2}\n", .{spawn_order_ns / std.time.ns_per_ms});
+    try writer.print("tree        {d:14.2}\n", .{tree_order_ns / std.time.ns_per_ms});
+}
+
+fn integrators(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    const integrator_fields = @typeInfo(Sim.Integrator).Enum.fields;
+
+    try writer.print("{d} bodies orbiting for {d}s simulated\n\n", .{ body_count, orbit_duration });
+    try writer.print("integrator        step rate  time (ms)  max energy err\n", .{});
+    inline for (integrator_fields) |field| {
+        for ([_]f32{ 15, 30, 60, 120, 240 }) |step_rate| {
+            const result = try orbit(allocator, @enumFromInt(field.value), step_rate, body_count, args);
+            try writer.print("{s:<16}  {d:9}  {d:9.2}  {e:14.3}\n", .{
+                field.name,
+                step_rate,
+                result.ms,
+                result.max_energy_err,
+            });
+        }
+    }
+
+    try writer.print("\nslowest step rate reaching an energy error of {e}\n\n", .{energy_target});
+    try writer.print("integrator        step rate  time (ms)\n", .{});
+    inline for (integrator_fields) |field| {
+        var step_rate: f32 = 8;
+        while (step_rate <= max_step_rate) : (step_rate *= 2) {
+            const result = try orbit(allocator, @enumFromInt(field.value), step_rate, body_count, args);
+            if (result.max_energy_err <= energy_target) {
+                try writer.print("{s:<16}  {d:9}  {d:9.2}\n", .{ field.name, step_rate, result.ms });
+                break;
+            }
+        } else {
+            try writer.print("{s:<16}  not reached by {d}\n", .{ field.name, max_step_rate });
+        }
+    }
+}
+
+const orbit_duration = 20;
+const energy_target = 1e-5;
+const max_step_rate = 4096;
+
+const Orbit = struct { ms: f64, max_energy_err: f64 };
+
+/// Runs the disc scene for `orbit_duration` simulated seconds, sampling the
+/// energy error along the way outside the timed sections.
+fn orbit(
+    allocator: std.mem.Allocator,
+    integrator: Sim.Integrator,
+    step_rate: f32,
+    body_count: usize,
+    args: Args,
+) !Orbit {
+    const samples = 20;
+
+    var sim = try initSim(args, .{
+        .allocator = allocator,
+        .integrator = integrator,
+    });
+    defer sim.deinit();
+    sim.dt = 1 / step_rate;
+    try sim.spawnDisc(body_count, args.seed);
+
+    const initial = sim.energy();
+    const steps: usize = @intFromFloat(orbit_duration * step_rate);
+    var max_err: f64 = 0;
+    var elapsed_ns: u64 = 0;
+    for (0..samples) |sample| {
+        var timer = try std.time.Timer.start();
+        for (sample * steps / samples..(sample + 1) * steps / samples) |_| {
+            try sim.step();
+        }
+        elapsed_ns += timer.read();
+        max_err = @max(max_err, @abs((sim.energy() - initial) / initial));
+    }
+
+    const ms = @as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_ms;
+    return .{ .ms = ms, .max_energy_err = max_err };
+}
+
+fn block(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    const duration = 1;
+
+    var sim = try initSim(args, .{ .allocator = allocator, .integrator = .block });
+    defer sim.deinit();
+    const steps: usize = @intFromFloat(@round(duration / sim.dt));
+    try sim.spawnClusters(body_count, args.seed);
+    const initial = sim.energy();
+
+    var deepest: Real = 0;
+    var timer = try std.time.Timer.start();
+    for (0..steps) |_| {
+        try sim.step();
+        for (sim.bodies.items(.level)) |level| deepest = @max(deepest, level);
+    }
+    const block_ms = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_ms;
+    const block_err = @abs((sim.energy() - initial) / initial);
+
+    const substeps: usize = @intFromFloat(std.math.exp2(deepest));
+    var reference = try initSim(args, .{
+        .allocator = allocator,
+        .integrator = .leapfrog,
+    });
+    defer reference.deinit();
+    reference.dt = sim.dt / @as(Real, @floatFromInt(substeps));
+    try reference.spawnClusters(body_count, args.seed);
+
+    timer.reset();
+    for (0..steps * substeps) |_| try reference.step();
+    const reference_ms = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_ms;
+    const reference_err = @abs((reference.energy() - initial) / initial);
+
+    try writer.print("{d} clustered bodies for {d}s simulated, deepest level {d}\n\n", .{
+        body_count,
+        duration,
+        deepest,
+    });
+    try writer.print("integrator  evaluations  time (ms)  energy err\n", .{});
+    try writer.print("block       {d:11}  {d:9.2}  {e:10.3}\n", .{
+        sim.evaluations,
+        block_ms,
+        block_err,
+    });
+    try writer.print("leapfrog    {d:11}  {d:9.2}  {e:10.3}\n", .{
+        reference.evaluations,
+        reference_ms,
+        reference_err,
+    });
+    try writer.print("\nspeedup {d:.1}x\n", .{reference_ms / block_ms});
+}
+
+fn collisions(allocator: std.mem.Allocator, writer: anytype, args: Args) !void {
+    const base_bodies = 10_000;
+    const base_bounds = V2{ 16.0 / 9.0, 1 };
+
+    try writer.print("bodies     time (ms)  ns/body\n", .{});
+    for ([_]usize{ 10_000, 100_000, 1_000_000 }) |body_count| {
+        // Grow the world with n so the density, and so the contacts per
+        // body, stay the same.
+        const scale: f32 = @sqrt(@as(f32, @floatFromInt(body_count)) / base_bodies);
+        var sim = try initSim(args, .{
+            .allocator = allocator,
+            .collisions = .inelastic,
+            .bounds = base_bounds * @as(V2, @splat(scale)),
+        });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        var timer = try std.time.Timer.start();
+        _ = try sim.computeBodyCollisions();
+        const elapsed_ns: f64 = @floatFromInt(timer.read());
+
+        try writer.print("{d:9}  {d:9.2}  {d:7.1}\n", .{
+            body_count,
+            elapsed_ns / std.time.ns_per_ms,
+            elapsed_ns / @as(f64, @floatFromInt(body_count)),
+        });
+    }
+}
+
+fn reorder(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    const all = try allocator.alloc(u32, body_count);
+    defer allocator.free(all);
+    for (all, 0..) |*index, i| index.* = @intCast(i);
+
+    try writer.print("{d} bodies\n\n", .{body_count});
+    try writer.print("order    sort (ms)  tree (ms)  collisions (ms)\n", .{});
+    for ([_]?Sim.Curve{ null, .morton, .hilbert }) |curve| {
+        var sim = try initSim(args, .{
+            .allocator = allocator,
+            .solver = .barnes_hut,
+            .collisions = .inelastic,
+        });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        var timer = try std.time.Timer.start();
+        if (curve) |c| try sim.spatial_sort.sort(sim.bodies, c, null);
+        const sort_ns: f64 = @floatFromInt(timer.read());
+
+        // A subset evaluation over every body traverses the tree without
+        // sorting the bodies itself.
+        timer.reset();
+        try sim.computeAccelerationsOf(all);
+        const tree_ns: f64 = @floatFromInt(timer.read());
+
+        timer.reset();
+        _ = try sim.computeBodyCollisions();
+        const collisions_ns: f64 = @floatFromInt(timer.read());
+
+        try writer.print("{s:7}  {d:9.2}  {d:9.2}  {d:15.2}\n", .{
+            if (curve) |c| @tagName(c) else "spawn",
+            sort_ns / std.time.ns_per_ms,
+            tree_ns / std.time.ns_per_ms,
+            collisions_ns / std.time.ns_per_ms,
+        });
+    }
+}
+
+fn mesh(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    {
+        var sim = try initSim(args, .{ .allocator = allocator });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        sim.solver = .direct;
+        const direct_ms = try timeAccelerations(&sim);
+        const reference_x = try allocator.dupe(Real, sim.bodies.items(.ax));
+        defer allocator.free(reference_x);
+        const reference_y = try allocator.dupe(Real, sim.bodies.items(.ay));
+        defer allocator.free(reference_y);
+
+        try writer.print("{d} bodies, direct sum {d:.2} ms\n\n", .{ body_count, direct_ms });
+        try writer.print("mesh  pm (ms)  mean rel err  max rel err  p3m (ms)  mean rel err  max rel err\n", .{});
+        for ([_]usize{ 64, 128, 256, 512, 1024 }) |size| {
+            sim.mesh_size = size;
+            try writer.print("{d:4}", .{size});
+            for ([_]Sim.Solver{ .particle_mesh, .p3m }) |solver| {
+                sim.solver = solver;
+                // The first solve on a new mesh also transforms its Green's
+                // function; time the ones after it.
+                try sim.computeAccelerations();
+                const ms = try timeAccelerations(&sim);
+                const err = compare(
+                    reference_x,
+                    reference_y,
+                    sim.bodies.items(.ax),
+                    sim.bodies.items(.ay),
+                );
+                try writer.print("  {d:8.2}  {e:12.3}  {e:11.3}", .{ ms, err.mean, err.max });
+            }
+            try writer.print("\n", .{});
+        }
+    }
+
+    try writer.print("\nbodies     mesh  pm (ms)  p3m (ms)  tree (ms)\n", .{});
+    for ([_]usize{ 10_000, 100_000, 1_000_000, 10_000_000 }) |n| {
+        var sim = try initSim(args, .{ .allocator = allocator });
+        defer sim.deinit();
+        try sim.spawnRandom(n, args.seed);
+        // About one node per body keeps the P3M neighbour count, and so its
+        // cost per body, roughly constant.
+        const sqrt_n: usize = @intFromFloat(@sqrt(@as(f64, @floatFromInt(n))));
+        sim.mesh_size = @min(try std.math.ceilPowerOfTwo(usize, sqrt_n), 2048);
+
+        sim.solver = .particle_mesh;
+        try sim.computeAccelerations();
+        const mesh_ms = try timeAccelerations(&sim);
+        sim.solver = .p3m;
+        try sim.computeAccelerations();
+        const p3m_ms = try timeAccelerations(&sim);
+        sim.solver = .barnes_hut;
+        const tree_ms = try timeAccelerations(&sim);
+        try writer.print("{d:9}  {d:4}  {d:7.2}  {d:8.2}  {d:9.2}\n", .{
+            n,
+            sim.mesh_size,
+            mesh_ms,
+            p3m_ms,
+            tree_ms,
+        });
+    }
+}
+
+fn fmm(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    body_count: usize,
+    args: Args,
+) !void {
+    {
+        var sim = try initSim(args, .{ .allocator = allocator });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        sim.solver = .direct;
+        const direct_ms = try timeAccelerations(&sim);
+        const reference_x = try allocator.dupe(Real, sim.bodies.items(.ax));
+        defer allocator.free(reference_x);
+        const reference_y = try allocator.dupe(Real, sim.bodies.items(.ay));
+        defer allocator.free(reference_y);
+
+        try writer.print("{d} bodies, direct sum {d:.2} ms\n\n", .{ body_count, direct_ms });
+        try writer.print("order  time (ms)  speedup  mean rel err  max rel err\n", .{});
+
+        sim.solver = .fmm;
+        for (1..FastMultipole.max_order + 1) |order| {
+            sim.fmm_order = order;
+            const ms = try timeAccelerations(&sim);
+            const err = compare(
+                reference_x,
+                reference_y,
+                sim.bodies.items(.ax),
+                sim.bodies.items(.ay),
+            );
+            try writer.print("{d:5}  {d:9.2}  {d:6.1}x  {e:12.3}  {e:11.3}\n", .{
+                order,
+                ms,
+                direct_ms / ms,
+                err.mean,
+                err.max,
+            });
+        }
+    }
+
+    try writer.print("\nbodies     fmm (ms)  ns/body  tree (ms)\n", .{});
+    for ([_]usize{ 10_000, 100_000, 1_000_000, 10_000_000 }) |n| {
+        var sim = try initSim(args, .{ .allocator = allocator });
+        defer sim.deinit();
+        try sim.spawnRandom(n, args.seed);
+
+        sim.solver = .fmm;
+        const fmm_ms = try timeAccelerations(&sim);
+        sim.solver = .barnes_hut;
+        const tree_ms = try timeAccelerations(&sim);
+        try writer.print("{d:9}  {d:8.2}  {d:7.1}  {d:9.2}\n", .{
+            n,
+            fmm_ms,
+            fmm_ms * std.time.ns_per_ms / @as(f64, @floatFromInt(n)),
+            tree_ms,
+        });
+    }
+}
+
+fn precisionMode(allocator: std.mem.Allocator, writer: anytype, args: Args) !void {
+    try writer.print("{s} precision: {s} storage, {s} forces, {d} lanes\n\n", .{
+        @tagName(precision.mode),
+        @typeName(Real),
+        @typeName(precision.Force),
+        kernel.lanes,
+    });
+
+    try writer.print("bodies  direct (ms)  interactions/s  tree (ms)  step (ms)\n", .{});
+    for ([_]usize{ 2_000, 8_000, 32_000 }) |body_count| {
+        var sim = try initSim(args, .{ .allocator = allocator, .integrator = .leapfrog });
+        defer sim.deinit();
+        try sim.spawnRandom(body_count, args.seed);
+
+        sim.solver = .direct;
+        const direct_ms = try timeAccelerations(&sim);
+        sim.solver = .barnes_hut;
+        const tree_ms = try timeAccelerations(&sim);
+
+        var timer = try std.time.Timer.start();
+        try sim.step();
+        const step_ms = @as(f64, @floatFromInt(timer.read())) / std.time.ns_per_ms;
+
+        const n: f64 = @floatFromInt(body_count);
+        try writer.print("{d:6}  {d:11.2}  {e:14.3}  {d:9.2}  {d:9.2}\n", .{
+            body_count,
+            direct_ms,
+            n * n / (direct_ms / std.time.ms_per_s),
+            tree_ms,
+            step_ms,
+        });
+    }
+
+    // The same orbits placed ever further from the origin, where f32
+    // positions run out of digits for the motion within one step.
+    try writer.print("\norbit centre  max energy err\n", .{});
+    for ([_]Real{ 1, 100, 10_000 }) |offset| {
+        var sim = try initSim(args, .{
+            .allocator = allocator,
+            .integrator = .leapfrog,
+            .bounds = @splat(2 * offset),
+        });
+        defer sim.deinit();
+        try sim.spawnDisc(default_orbiting_bodies, args.seed);
+
+        const initial = sim.energy();
+        var max_err: f64 = 0;
+        const steps_per_second: usize = @intFromFloat(@round(1 / sim.dt));
+        for (0..10) |_| {
+            for (0..steps_per_second) |_| try sim.step();
+            max_err = @max(max_err, @abs((sim.energy() - initial) / initial));
+        }
+        try writer.print("{d:12}  {e:14.3}\n", .{ offset, max_err });
+    }
+}
+
+/// A sim set up like `sim` and then tuned by the command line, so
+/// --softening, --theta, --step-rate, --mesh-size, --fmm-order and --threads
+/// apply to every benchmark. A benchmark that sweeps one of them overwrites
+/// it afterwards.
+fn initSim(args: Args, sim: Sim) !Sim {
+    var result = Sim.init(sim);
+    errdefer result.deinit();
+    try args.tune(&result);
+    return result;
+}
+
+fn timeAccelerations(sim: *Sim) !f64 {
+    var timer = try std.time.Timer.start();
+    try sim.computeAccelerations();
+    const elapsed_ns: f64 = @floatFromInt(timer.read());
+    return elapsed_ns / std.time.ns_per_ms;
+}
+
+const Error = struct { mean: f64, max: f64 };
+
+/// Relative error of each acceleration against the reference, skipping
+/// bodies that feel no force at all.
+fn compare(
+    expected_x: []const Real,
+    expected_y: []const Real,
+    actual_x: []const Real,
+    actual_y: []const Real,
+) Error {
+    var sum: f64 = 0;
+    var max: f64 = 0;
+    var count: usize = 0;
+    for (expected_x, expected_y, actual_x, actual_y) |ex, ey, ax, ay| {
+        const expected = V2{ ex, ey };
+        const got = V2{ ax, ay };
+        const magnitude = length(expected);
+        if (magnitude == 0) continue;
+        const err = length(got - expected) / magnitude;
+        sum += err;
+        max = @max(max, err);
+        count += 1;
+    }
+    const mean = if (count == 0) 0 else sum / @as(f64, @floatFromInt(count));
+    return .{ .mean = mean, .max = max };
+}
+
+inline fn length(v: V2) f64 {
+    const x: f64 = v[0];
+    const y: f64 = v[1];
+    return @sqrt(x * x + y * y);
+}
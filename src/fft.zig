@@ -0,0 +1,144 @@
+const Sim = @import("Sim.zig");
+const std = @import("std");
+
+pub const Complex = std.math.Complex(Sim.Real);
+
+/// Fills `table` with the twiddle factors `e^(-2 pi i k / n)` for
+/// `k < n / 2`, where `n = 2 * table.len`, as `transform` expects for
+/// length-`n` data.
+pub fn twiddles(table: []Complex) void {
+    const n: Sim.Real = @floatFromInt(2 * table.len);
+    for (table, 0..) |*w, k| {
+        const angle = -std.math.tau * @as(Sim.Real, @floatFromInt(k)) / n;
+        w.* = Complex.init(@cos(angle), @sin(angle));
+    }
+}
+
+/// In-place iterative radix-2 FFT. `data.len` must be a power of two and
+/// `table` must come from `twiddles` for a length that is a multiple of it.
+/// The inverse is unscaled.
+pub fn transform(data: []Complex, table: []const Complex, inverse: bool) void {
+    const n = data.len;
+    if (n < 2) return;
+
+    var j: usize = 0;
+    for (1..n) |i| {
+        var bit = n >> 1;
+        while (j & bit != 0) : (bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std.mem.swap(Complex, &data[i], &data[j]);
+    }
+
+    const table_stride = table.len * 2 / n;
+    var len: usize = 2;
+    while (len <= n) : (len <<= 1) {
+        const half = len / 2;
+        const stride = n / len * table_stride;
+        var start: usize = 0;
+        while (start < n) : (start += len) {
+            for (0..half) |k| {
+                const w = if (inverse) table[k * stride].conjugate() else table[k * stride];
+                const a = data[start + k];
+                const b = data[start + k + half].mul(w);
+                data[start + k] = a.add(b);
+                data[start + k + half] = a.sub(b);
+            }
+        }
+    }
+}
+
+/// 2D FFT of a row-major `n` by `n` grid, using `column` (length `n`) as
+/// scratch. Only the first `row_count` rows are transformed along their
+/// length: in the forward direction the rest must be zero, and in the
+/// inverse direction the rest are left unfinished. The inverse is scaled
+/// by `1 / n^2`.
+pub fn transform2d(
+    grid: []Complex,
+    n: usize,
+    row_count: usize,
+    table: []const Complex,
+    column: []Complex,
+    inverse: bool,
+) void {
+    if (!inverse) transformRows(grid, n, row_count, table, false);
+
+    for (0..n) |c| {
+        for (column, 0..) |*value, r| value.* = grid[r * n + c];
+        transform(column, table, inverse);
+        for (column, 0..) |value, r| grid[r * n + c] = value;
+    }
+
+    if (inverse) {
+        transformRows(grid, n, row_count, table, true);
+        const scale = 1 / @as(Sim.Real, @floatFromInt(n * n));
+        for (grid[0 .. row_count * n]) |*value| {
+            value.* = Complex.init(value.re * scale, value.im * scale);
+        }
+    }
+}
+
+fn transformRows(
+    grid: []Complex,
+    n: usize,
+    row_count: usize,
+    table: []const Complex,
+    inverse: bool,
+) void {
+    for (0..row_count) |r| transform(grid[r * n ..][0..n], table, inverse);
+}
+
+fn expectClose(expected: []const Complex, actual: []const Complex, tolerance: Sim.Real) !void {
+    for (expected, actual) |e, a| {
+        try std.testing.expectApproxEqAbs(e.re, a.re, tolerance);
+        try std.testing.expectApproxEqAbs(e.im, a.im, tolerance);
+    }
+}
+
+fn randomData(data: []Complex, seed: u64) void {
+    var prng = std.rand.DefaultPrng.init(seed);
+    const random = prng.random();
+    for (data) |*value| {
+        value.* = Complex.init(random.float(Sim.Real) - 0.5, random.float(Sim.Real) - 0.5);
+    }
+}
+
+test "transform matches a direct DFT and inverts" {
+    const n = 16;
+    var data: [n]Complex = undefined;
+    randomData(&data, 1);
+    const original = data;
+
+    var expected: [n]Complex = undefined;
+    for (&expected, 0..) |*sum, k| {
+        sum.* = Complex.init(0, 0);
+        for (original, 0..) |value, j| {
+            const angle = -std.math.tau * @as(Sim.Real, @floatFromInt(j * k % n)) / n;
+            sum.* = sum.add(value.mul(Complex.init(@cos(angle), @sin(angle))));
+        }
+    }
+
+    // A table for twice the length is used with a stride of two.
+    var table: [n]Complex = undefined;
+    twiddles(&table);
+    transform(&data, &table, false);
+    try expectClose(&expected, &data, 1e-4);
+
+    transform(&data, &table, true);
+    for (&data) |*value| value.* = Complex.init(value.re / n, value.im / n);
+    try expectClose(&original, &data, 1e-5);
+}
+
+test "transform2d inverts on the rows it was given" {
+    const n = 8;
+    const row_count = n / 2;
+    var grid = [_]Complex{Complex.init(0, 0)} ** (n * n);
+    randomData(grid[0 .. row_count * n], 2);
+    const original = grid;
+
+    var table: [n / 2]Complex = undefined;
+    twiddles(&table);
+    var column: [n]Complex = undefined;
+    transform2d(&grid, n, row_count, &table, &column, false);
+    transform2d(&grid, n, row_count, &table, &column, true);
+    try expectClose(original[0 .. row_count * n], grid[0 .. row_count * n], 1e-5);
+}
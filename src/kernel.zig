@@ -0,0 +1,211 @@
+const Sim = @import("Sim.zig");
+const builtin = @import("builtin");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const Force = precision.Force;
+const Real = precision.Real;
+const V2 = Sim.V2;
+const cast = precision.cast;
+
+/// SIMD width of the direct-sum kernel: one register of `Force`, picked
+/// from the target CPU.
+pub const lanes = @divExact(if (builtin.cpu.arch.isX86() and
+    std.Target.x86.featureSetHas(builtin.cpu.features, .avx512f)) 512 else 256, @bitSizeOf(Force));
+
+const F = @Vector(lanes, Force);
+const R = @Vector(lanes, Real);
+pub const F2 = @Vector(2, Force);
+
+/// Bodies exerting gravity, as parallel arrays of equal length, and the
+/// square of the Plummer softening length. Softening turns each pair into
+/// `m d / (|d|^2 + eps^2)^(3/2)`, which stays finite at any separation, so no
+/// pair needs to be skipped. A body's pull on itself is zero because its
+/// separation is, provided the softening is not.
+pub const Sources = struct {
+    x: []const Real,
+    y: []const Real,
+    mass: []const Real,
+    softening_sq: Real,
+};
+
+/// Acceleration on body `i` of `sources` per unit of g, evaluated against
+/// `lanes` sources per iteration without branches. Separations are taken in
+/// `Real` and everything after them is done in `Force`.
+pub fn accel(sources: Sources, i: usize) V2 {
+    @setFloatMode(.optimized);
+
+    const x: R = @splat(sources.x[i]);
+    const y: R = @splat(sources.y[i]);
+    const softening_sq: F = @splat(cast(Force, sources.softening_sq));
+    const zero: F = @splat(0);
+    const one: F = @splat(1);
+
+    var ax = zero;
+    var ay = zero;
+
+    const len = sources.x.len;
+    const tiled_len = len - len % lanes;
+    var j: usize = 0;
+    while (j < tiled_len) : (j += lanes) {
+        const dx = cast(F, @as(R, sources.x[j..][0..lanes].*) - x);
+        const dy = cast(F, @as(R, sources.y[j..][0..lanes].*) - y);
+        const mass_j = cast(F, @as(R, sources.mass[j..][0..lanes].*));
+
+        const dist_sq = dx * dx + dy * dy + softening_sq;
+        const inv_dist = one / @sqrt(dist_sq);
+        const strength = mass_j * inv_dist * inv_dist * inv_dist;
+
+        ax += dx * strength;
+        ay += dy * strength;
+    }
+
+    var result = F2{ @reduce(.Add, ax), @reduce(.Add, ay) };
+    for (tiled_len..len) |k| result += pairAccel(sources, i, k);
+    return cast(V2, result);
+}
+
+/// Acceleration and its time derivative on one body, both per unit of g.
+pub const AccelJerk = struct {
+    accel: V2,
+    jerk: V2,
+};
+
+/// Acceleration and jerk on body `i` of `sources`, whose velocities are
+/// `vx`/`vy`, for the Hermite integrator. Softened like `accel`.
+pub fn accelJerk(sources: Sources, vx: []const Real, vy: []const Real, i: usize) AccelJerk {
+    @setFloatMode(.optimized);
+
+    const x: R = @splat(sources.x[i]);
+    const y: R = @splat(sources.y[i]);
+    const vx_i: R = @splat(vx[i]);
+    const vy_i: R = @splat(vy[i]);
+    const softening_sq: F = @splat(cast(Force, sources.softening_sq));
+    const three: F = @splat(3);
+    const zero: F = @splat(0);
+    const one: F = @splat(1);
+
+    var ax = zero;
+    var ay = zero;
+    var jx = zero;
+    var jy = zero;
+
+    const len = sources.x.len;
+    const tiled_len = len - len % lanes;
+    var j: usize = 0;
+    while (j < tiled_len) : (j += lanes) {
+        const dx = cast(F, @as(R, sources.x[j..][0..lanes].*) - x);
+        const dy = cast(F, @as(R, sources.y[j..][0..lanes].*) - y);
+        const dvx = cast(F, @as(R, vx[j..][0..lanes].*) - vx_i);
+        const dvy = cast(F, @as(R, vy[j..][0..lanes].*) - vy_i);
+        const mass_j = cast(F, @as(R, sources.mass[j..][0..lanes].*));
+        const dist_sq = dx * dx + dy * dy + softening_sq;
+
+        const inv_dist_sq = one / dist_sq;
+        const strength = mass_j * inv_dist_sq * @sqrt(inv_dist_sq);
+        const rate = three * (dx * dvx + dy * dvy) * inv_dist_sq;
+
+        ax += dx * strength;
+        ay += dy * strength;
+        jx += (dvx - rate * dx) * strength;
+        jy += (dvy - rate * dy) * strength;
+    }
+
+    var accel_sum = F2{ @reduce(.Add, ax), @reduce(.Add, ay) };
+    var jerk_sum = F2{ @reduce(.Add, jx), @reduce(.Add, jy) };
+    for (tiled_len..len) |k| {
+        const pair = pairAccelJerk(sources, vx, vy, i, k);
+        accel_sum += pair[0];
+        jerk_sum += pair[1];
+    }
+    return .{ .accel = cast(V2, accel_sum), .jerk = cast(V2, jerk_sum) };
+}
+
+inline fn pairAccelJerk(
+    sources: Sources,
+    vx: []const Real,
+    vy: []const Real,
+    i: usize,
+    j: usize,
+) [2]F2 {
+    const dx = cast(Force, sources.x[j] - sources.x[i]);
+    const dy = cast(Force, sources.y[j] - sources.y[i]);
+    const dvx = cast(Force, vx[j] - vx[i]);
+    const dvy = cast(Force, vy[j] - vy[i]);
+    const dist_sq = dx * dx + dy * dy + cast(Force, sources.softening_sq);
+    const dist = @sqrt(dist_sq);
+
+    const strength = cast(Force, sources.mass[j]) / (dist_sq * dist);
+    const rate = 3 * (dx * dvx + dy * dvy) / dist_sq;
+    return .{
+        .{ dx * strength, dy * strength },
+        .{ (dvx - rate * dx) * strength, (dvy - rate * dy) * strength },
+    };
+}
+
+/// Scalar reference for `accel`, one source at a time.
+pub fn accelScalar(sources: Sources, i: usize) V2 {
+    var result = F2{ 0, 0 };
+    for (0..sources.x.len) |j| result += pairAccel(sources, i, j);
+    return cast(V2, result);
+}
+
+/// Softened acceleration of body `i` towards source `j`, per unit `g`.
+pub inline fn pairAccel(sources: Sources, i: usize, j: usize) F2 {
+    const dx = cast(Force, sources.x[j] - sources.x[i]);
+    const dy = cast(Force, sources.y[j] - sources.y[i]);
+    const dist_sq = dx * dx + dy * dy + cast(Force, sources.softening_sq);
+    const dist = @sqrt(dist_sq);
+
+    const strength = cast(Force, sources.mass[j]) / (dist_sq * dist);
+    return .{ dx * strength, dy * strength };
+}
+
+fn testSources(allocator: std.mem.Allocator, len: usize, seed: u64) !Sources {
+    var prng = std.rand.DefaultPrng.init(seed);
+    const random = prng.random();
+    const x = try allocator.alloc(Real, len);
+    const y = try allocator.alloc(Real, len);
+    const mass = try allocator.alloc(Real, len);
+    for (x, y, mass) |*px, *py, *m| {
+        px.* = random.float(Real);
+        py.* = random.float(Real);
+        m.* = 1e-3 + random.float(Real);
+    }
+    return .{ .x = x, .y = y, .mass = mass, .softening_sq = 1e-6 };
+}
+
+test "accel matches accelScalar for lengths around the lane width" {
+    var arena = std.heap.ArenaAllocator.init(std.testing.allocator);
+    defer arena.deinit();
+
+    const lengths = [_]usize{ 1, 3, lanes - 1, lanes + 1, 3 * lanes + 5, 257 };
+    for (lengths, 0..) |len, seed| {
+        const sources = try testSources(arena.allocator(), len, seed);
+        for (0..len) |i| {
+            const vector = accel(sources, i);
+            const scalar = accelScalar(sources, i);
+            // Compare against the size of the terms rather than of the sum,
+            // which may cancel to almost nothing.
+            var scale: Force = 0;
+            for (0..len) |j| {
+                const pair = pairAccel(sources, i, j);
+                scale += @sqrt(pair[0] * pair[0] + pair[1] * pair[1]);
+            }
+            const tolerance = cast(Real, scale) * 1e-4;
+            try std.testing.expectApproxEqAbs(scalar[0], vector[0], tolerance);
+            try std.testing.expectApproxEqAbs(scalar[1], vector[1], tolerance);
+        }
+    }
+}
+
+test "a body does not pull on itself" {
+    const sources = Sources{
+        .x = &.{0.5},
+        .y = &.{0.5},
+        .mass = &.{1},
+        .softening_sq = 1e-6,
+    };
+    try std.testing.expectEqual(V2{ 0, 0 }, accel(sources, 0));
+    try std.testing.expectEqual(V2{ 0, 0 }, accelScalar(sources, 0));
+}
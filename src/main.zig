@@ -1,21 +1,87 @@
+const Args = @import("Args.zig");
 const Game = @import("Game.zig");
+const bench = @import("bench.zig");
+const savestate = @import("savestate.zig");
+const Sim = @import("Sim.zig");
+const SimThread = @import("SimThread.zig");
 const std = @import("std");
 
+const width = 2560;
+const height = 1440;
+const default_save_path = "nbody2.state";
+
 pub fn main() !void {
-    var arena = std.heap.ArenaAllocator.init(std.heap.page_allocator);
-    defer arena.deinit();
+    // Everything long-lived is freed by its owner, so a general purpose
+    // allocator gives memory back instead of growing for the whole run.
+    // Bodies reserve their own address space, and the per-step structures
+    // keep their buffers between steps.
+    var gpa = std.heap.GeneralPurposeAllocator(.{ .thread_safe = true }){};
+    defer _ = gpa.deinit();
+    const allocator = gpa.allocator();
+
+    const args = try Args.parse(allocator);
+    defer args.deinit(allocator);
+    if (args.bench) |benchmark| return bench.run(allocator, args, benchmark);
+    if (args.headless) return runHeadless(allocator, args);
+
+    var sim = Sim.init(.{ .allocator = allocator });
+    try configure(&sim, args);
 
     var game = Game.init(.{
-        .allocator = arena.allocator(),
+        .allocator = allocator,
         .name = "nbody2",
-        .width = 2560,
-        .height = 1440,
+        .width = width,
+        .height = height,
+        .sim = try SimThread.spawn(allocator, sim),
+        .save_path = args.save orelse args.load orelse default_save_path,
     });
     defer game.deinit();
 
     while (!game.shouldQuit()) {
         game.frameBegin();
         defer game.frameEnd();
-        try game.updateAndRender();
+        game.update();
+        game.render();
     }
 }
+
+fn configure(sim: *Sim, args: Args) !void {
+    try args.tune(sim);
+    // Hermite never drifts, so there would be nothing to sweep.
+    if (args.ccd and args.integrator == .hermite) return error.InvalidIntegratorForCcd;
+    sim.solver = args.solver;
+    sim.integrator = args.integrator;
+    sim.collisions = args.collisions;
+    sim.ccd = args.ccd;
+    sim.reorder_interval = args.reorder_interval;
+    sim.reorder_curve = args.reorder_curve;
+    if (args.load) |path| try savestate.load(sim, path);
+    try sim.spawn(args.scene, args.bodies, args.seed);
+}
+
+/// Steps the simulation as fast as possible without touching raylib.
+fn runHeadless(allocator: std.mem.Allocator, args: Args) !void {
+    var sim = Sim.init(.{
+        .allocator = allocator,
+        .bounds = .{ @as(f32, width) / @as(f32, height), 1 },
+    });
+    defer sim.deinit();
+    try configure(&sim, args);
+
+    var timer = try std.time.Timer.start();
+    for (0..args.steps) |_| try sim.step();
+    const elapsed_ns: f64 = @floatFromInt(timer.read());
+
+    const seconds = elapsed_ns / std.time.ns_per_s;
+    const steps: f64 = @floatFromInt(args.steps);
+    const stdout = std.io.getStdOut().writer();
+    try stdout.print("{d} bodies, {d} steps ({d:.2}s simulated) in {d:.3}s ({d:.1} steps/s)\n", .{
+        sim.bodies.len,
+        args.steps,
+        steps * @as(f64, sim.dt),
+        seconds,
+        steps / seconds,
+    });
+
+    if (args.save) |path| try savestate.save(&sim, path);
+}
@@ -0,0 +1,251 @@
+const Pool = @import("Pool.zig");
+const Sim = @import("Sim.zig");
+const std = @import("std");
+
+const Real = Sim.Real;
+const V2 = Sim.V2;
+
+/// Bits of each coordinate in a key. Keys address a 2^16 by 2^16 grid, so a
+/// quadtree built from them is at most this deep.
+pub const bits_per_axis = 16;
+pub const Key = u32;
+
+const digit_bits = 8;
+const digit_count = @bitSizeOf(Key) / digit_bits;
+const radix = 1 << digit_bits;
+/// Most pieces the sort splits the keys into, one per thread.
+const max_pieces = 64;
+
+/// Space-filling curve to order keys along.
+pub const Curve = enum {
+    /// Z-order. Cheap, and what the quadtree is built from, but with long
+    /// jumps between quadrants.
+    morton,
+    /// Hilbert order. Consecutive keys are always adjacent cells, so runs of
+    /// bodies stay more compact.
+    hilbert,
+};
+
+/// Interleaves the bits of `ix` and `iy`, x in the low bit of each pair, so
+/// sorting by key walks the grid along a Z-order curve.
+pub fn encode(ix: u16, iy: u16) Key {
+    return spread(ix) | spread(iy) << 1;
+}
+
+/// Distance of cell (ix, iy) along the Hilbert curve through the grid.
+pub fn hilbert(ix: u16, iy: u16) Key {
+    var x: Key = ix;
+    var y: Key = iy;
+    var d: Key = 0;
+    var s: Key = 1 << (bits_per_axis - 1);
+    while (s > 0) : (s >>= 1) {
+        const rx: Key = @intFromBool(x & s != 0);
+        const ry: Key = @intFromBool(y & s != 0);
+        d += s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so the curve's sub-square starts where the
+        // last one ended. Only the bits below `s` matter from here on.
+        if (ry == 0) {
+            if (rx == 1) {
+                x = ~x;
+                y = ~y;
+            }
+            std.mem.swap(Key, &x, &y);
+        }
+    }
+    return d;
+}
+
+fn spread(value: u16) Key {
+    var v: Key = value;
+    v = (v | v << 8) & 0x00ff00ff;
+    v = (v | v << 4) & 0x0f0f0f0f;
+    v = (v | v << 2) & 0x33333333;
+    v = (v | v << 1) & 0x55555555;
+    return v;
+}
+
+/// Fills `keys` with the position along `curve` of each point within the
+/// square of side `size` whose low corner is `min`. Points outside it are
+/// clamped to its edge.
+pub fn computeKeys(
+    x: []const Real,
+    y: []const Real,
+    min: V2,
+    size: Real,
+    curve: Curve,
+    keys: []Key,
+    pool: ?*Pool,
+) void {
+    const pass = KeyPass{
+        .x = x,
+        .y = y,
+        .min = min,
+        .size = size,
+        .curve = curve,
+        .keys = keys,
+    };
+    if (pool) |p| {
+        p.parallelFor(keys.len, 4096, pass, KeyPass.run);
+    } else {
+        pass.run(0, keys.len);
+    }
+}
+
+const KeyPass = struct {
+    x: []const Real,
+    y: []const Real,
+    min: V2,
+    size: Real,
+    curve: Curve,
+    keys: []Key,
+
+    fn run(self: KeyPass, start: usize, end: usize) void {
+        const cells: Real = 1 << bits_per_axis;
+        const scale = cells / self.size;
+        for (start..end) |i| {
+            const ix = std.math.clamp((self.x[i] - self.min[0]) * scale, 0, cells - 1);
+            const iy = std.math.clamp((self.y[i] - self.min[1]) * scale, 0, cells - 1);
+            self.keys[i] = switch (self.curve) {
+                .morton => encode(@intFromFloat(ix), @intFromFloat(iy)),
+                .hilbert => hilbert(@intFromFloat(ix), @intFromFloat(iy)),
+            };
+        }
+    }
+};
+
+/// Stable LSD radix sort of `keys`, applying the same moves to `values`.
+/// The scratch slices must be as long as `keys`. Each digit pass counts and
+/// scatters one contiguous piece of the keys per pool thread; the pieces'
+/// counts are combined in order in between, so the result does not depend
+/// on the thread count.
+pub fn sort(
+    keys: []Key,
+    values: []u32,
+    scratch_keys: []Key,
+    scratch_values: []u32,
+    pool: ?*Pool,
+) void {
+    const piece_count = if (pool) |p| @min(p.threadCount(), max_pieces) else 1;
+    var counts: [max_pieces][radix]u32 = undefined;
+
+    var pass = DigitPass{
+        .from_keys = keys,
+        .from_values = values,
+        .to_keys = scratch_keys,
+        .to_values = scratch_values,
+        .counts = counts[0..piece_count],
+        .piece_len = std.math.divCeil(usize, keys.len, piece_count) catch unreachable,
+        .shift = 0,
+    };
+    for (0..digit_count) |digit| {
+        pass.shift = @intCast(digit * digit_bits);
+        if (pool) |p| {
+            p.parallelFor(piece_count, 1, pass, DigitPass.count);
+        } else {
+            pass.count(0, piece_count);
+        }
+
+        // Turn the counts into each piece's first slot for every digit value,
+        // pieces in order within a value.
+        var total: u32 = 0;
+        for (0..radix) |value| {
+            for (pass.counts) |*piece_counts| {
+                const n = piece_counts[value];
+                piece_counts[value] = total;
+                total += n;
+            }
+        }
+
+        if (pool) |p| {
+            p.parallelFor(piece_count, 1, pass, DigitPass.scatter);
+        } else {
+            pass.scatter(0, piece_count);
+        }
+        std.mem.swap([]Key, &pass.from_keys, &pass.to_keys);
+        std.mem.swap([]u32, &pass.from_values, &pass.to_values);
+    }
+    // An even number of passes leaves the result back in `keys`/`values`.
+    comptime std.debug.assert(digit_count % 2 == 0);
+}
+
+const DigitPass = struct {
+    from_keys: []Key,
+    from_values: []u32,
+    to_keys: []Key,
+    to_values: []u32,
+    counts: [][radix]u32,
+    piece_len: usize,
+    shift: u5,
+
+    fn piece(self: DigitPass, index: usize) []const Key {
+        const start = @min(index * self.piece_len, self.from_keys.len);
+        const end = @min(start + self.piece_len, self.from_keys.len);
+        return self.from_keys[start..end];
+    }
+
+    fn count(self: DigitPass, start: usize, end: usize) void {
+        for (start..end) |index| {
+            const piece_counts = &self.counts[index];
+            @memset(piece_counts, 0);
+            for (self.piece(index)) |key| piece_counts[(key >> self.shift) & (radix - 1)] += 1;
+        }
+    }
+
+    fn scatter(self: DigitPass, start: usize, end: usize) void {
+        for (start..end) |index| {
+            const piece_counts = &self.counts[index];
+            const first = @min(index * self.piece_len, self.from_keys.len);
+            for (self.piece(index), first..) |key, from| {
+                const slot = &piece_counts[(key >> self.shift) & (radix - 1)];
+                self.to_keys[slot.*] = key;
+                self.to_values[slot.*] = self.from_values[from];
+                slot.* += 1;
+            }
+        }
+    }
+};
+
+test "sort orders keys and keeps equal keys in input order" {
+    const n = 1000;
+    var keys: [n]Key = undefined;
+    var values: [n]u32 = undefined;
+    var scratch_keys: [n]Key = undefined;
+    var scratch_values: [n]u32 = undefined;
+
+    // Few distinct keys, spread over every digit, so most have company.
+    var prng = std.rand.DefaultPrng.init(1);
+    const random = prng.random();
+    for (&keys, &values, 0..) |*key, *value, i| {
+        key.* = random.uintLessThan(Key, 16) *% 0x1010_1011;
+        value.* = @intCast(i);
+    }
+    const input = keys;
+
+    sort(&keys, &values, &scratch_keys, &scratch_values, null);
+
+    for (keys, values) |key, value| try std.testing.expectEqual(input[value], key);
+    for (keys[0 .. n - 1], keys[1..], values[0 .. n - 1], values[1..]) |a, b, value_a, value_b| {
+        try std.testing.expect(a <= b);
+        if (a == b) try std.testing.expect(value_a < value_b);
+    }
+}
+
+test "hilbert steps between adjacent cells" {
+    // The curve fills each aligned square before leaving it, so the first
+    // side^2 distances cover the square at the origin.
+    const side = 16;
+    var cells: [side * side]?[2]u16 = .{null} ** (side * side);
+    for (0..side) |ix| {
+        for (0..side) |iy| {
+            const d = hilbert(@intCast(ix), @intCast(iy));
+            try std.testing.expect(d < cells.len);
+            try std.testing.expect(cells[d] == null);
+            cells[d] = .{ @intCast(ix), @intCast(iy) };
+        }
+    }
+    for (cells[0 .. cells.len - 1], cells[1..]) |a, b| {
+        const dx = @abs(@as(i32, a.?[0]) - b.?[0]);
+        const dy = @abs(@as(i32, a.?[1]) - b.?[1]);
+        try std.testing.expectEqual(@as(u32, 1), dx + dy);
+    }
+}
@@ -0,0 +1,24 @@
+const build_options = @import("build_options");
+
+/// Floating point layout of the simulation, chosen with `-Dprecision`.
+pub const Precision = @TypeOf(build_options.precision);
+pub const mode: Precision = build_options.precision;
+
+/// Scalar of the body store and of everything integrated from it.
+pub const Real = switch (mode) {
+    .f32 => f32,
+    .f64, .mixed => f64,
+};
+
+/// Scalar the force kernels do their arithmetic and accumulation in. In
+/// mixed mode separations are taken in f64 and only then narrowed, so large
+/// coordinates keep their precision while the kernels keep f32 throughput.
+pub const Force = switch (mode) {
+    .f32, .mixed => f32,
+    .f64 => f64,
+};
+
+/// Converts a float or float vector to `T`, whichever way it goes.
+pub inline fn cast(comptime T: type, value: anytype) T {
+    return if (@TypeOf(value) == T) value else @floatCast(value);
+}
@@ -0,0 +1,5 @@
+pub usingnamespace @cImport({
+    @cInclude("raylib.h");
+    @cInclude("raymath.h");
+    @cInclude("rlgl.h");
+});
@@ -0,0 +1,280 @@
+const Bodies = @import("Bodies.zig");
+const Sim = @import("Sim.zig");
+const builtin = @import("builtin");
+const precision = @import("precision.zig");
+const std = @import("std");
+
+const Real = Sim.Real;
+
+const magic = "NBD2".*;
+const version = 2;
+
+/// Fixed-size little-endian header, padded so that the body arrays which
+/// follow it start on a cache line. Each array is `body_count` floats of
+/// `real_size` bytes, in the order given by `fields`.
+const Header = extern struct {
+    magic: [4]u8 = magic,
+    version: u32 = version,
+    body_count: u64,
+    g: f64,
+    dt: f64,
+    bounds: [2]f64,
+    real_size: u32 = @sizeOf(Real),
+    reserved: [12]u8 = [_]u8{0} ** 12,
+};
+
+const fields = [_]Bodies.Field{ .x, .y, .vx, .vy, .mass, .radius };
+
+comptime {
+    std.debug.assert(@sizeOf(Header) == 64);
+    if (builtin.cpu.arch.endian() != .little) {
+        @compileError("save states are little-endian and read without byte swapping");
+    }
+}
+
+/// Writes the full simulation state to `path` with one vectored write.
+pub fn save(sim: *const Sim, path: []const u8) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    const header = Header{
+        .body_count = sim.bodies.len,
+        .g = sim.g,
+        .dt = sim.dt,
+        .bounds = .{ sim.bounds[0], sim.bounds[1] },
+    };
+
+    var iovecs: [1 + fields.len]std.posix.iovec_const = undefined;
+    iovecs[0] = .{ .iov_base = std.mem.asBytes(&header), .iov_len = @sizeOf(Header) };
+    inline for (fields, 1..) |field, i| {
+        const bytes = std.mem.sliceAsBytes(sim.bodies.items(field));
+        iovecs[i] = .{ .iov_base = bytes.ptr, .iov_len = bytes.len };
+    }
+    try file.writevAll(&iovecs);
+}
+
+/// Replaces the simulation state with the contents of `path`. The file is
+/// mapped rather than read where the platform allows it. Files saved by a
+/// build of another precision are converted.
+pub fn load(sim: *Sim, path: []const u8) !void {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+
+    const size = std.math.cast(usize, try file.getEndPos()) orelse
+        return error.InvalidSaveState;
+    if (size < @sizeOf(Header)) return error.InvalidSaveState;
+
+    if (builtin.os.tag == .windows) {
+        const bytes = try file.readToEndAlloc(sim.allocator, size);
+        defer sim.allocator.free(bytes);
+        return fromBytes(sim, bytes);
+    }
+
+    const mapped = try std.posix.mmap(
+        null,
+        size,
+        std.posix.PROT.READ,
+        .{ .TYPE = .PRIVATE },
+        file.handle,
+        0,
+    );
+    defer std.posix.munmap(mapped);
+    return fromBytes(sim, mapped);
+}
+
+fn fromBytes(sim: *Sim, bytes: []const u8) !void {
+    const header = std.mem.bytesToValue(Header, bytes[0..@sizeOf(Header)]);
+    if (!std.mem.eql(u8, &header.magic, &magic)) return error.InvalidSaveState;
+    if (header.version != version) return error.UnsupportedSaveStateVersion;
+
+    if (header.real_size != 4 and header.real_size != 8) return error.InvalidSaveState;
+
+    const count = std.math.cast(usize, header.body_count) orelse
+        return error.InvalidSaveState;
+    const array_len = std.math.mul(usize, count, header.real_size) catch
+        return error.InvalidSaveState;
+    const body_len = std.math.mul(usize, array_len, fields.len) catch
+        return error.InvalidSaveState;
+    if (bytes.len - @sizeOf(Header) != body_len) return error.InvalidSaveState;
+
+    // Checked after narrowing, so a value that only overflows as Real is
+    // caught too. A non-positive or NaN step would stall or crash advance.
+    const g = precision.cast(Real, header.g);
+    const dt = precision.cast(Real, header.dt);
+    const bounds = precision.cast(Sim.V2, @as(@Vector(2, f64), header.bounds));
+    if (!isPositive(g) or !isPositive(dt)) return error.InvalidSaveState;
+    if (!isPositive(bounds[0]) or !isPositive(bounds[1])) return error.InvalidSaveState;
+
+    // Loaded bodies are new bodies, with fresh IDs.
+    sim.bodies.clear();
+    try sim.bodies.resize(count);
+    inline for (fields, 0..) |field, i| {
+        const start = @sizeOf(Header) + i * array_len;
+        const stored = bytes[start..][0..array_len];
+        switch (header.real_size) {
+            4 => copyField(f32, sim.bodies.items(field), stored),
+            8 => copyField(f64, sim.bodies.items(field), stored),
+            else => unreachable,
+        }
+    }
+    @memcpy(sim.bodies.items(.prev_x), sim.bodies.items(.x));
+    @memcpy(sim.bodies.items(.prev_y), sim.bodies.items(.y));
+    @memset(sim.bodies.items(.ax), 0);
+    @memset(sim.bodies.items(.ay), 0);
+
+    sim.g = g;
+    sim.dt = dt;
+    sim.bounds = bounds;
+    sim.accumulator = 0;
+    sim.accelerations_stale = true;
+}
+
+inline fn isPositive(value: Real) bool {
+    return std.math.isFinite(value) and value > 0;
+}
+
+fn copyField(comptime Stored: type, values: []Real, bytes: []const u8) void {
+    if (Stored == Real) {
+        @memcpy(std.mem.sliceAsBytes(values), bytes);
+    } else {
+        for (values, std.mem.bytesAsSlice(Stored, bytes)) |*value, stored| {
+            value.* = precision.cast(Real, stored);
+        }
+    }
+}
+
+test "save and load round trip" {
+    const allocator = std.testing.allocator;
+    var tmp = std.testing.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+    const path = try std.fs.path.join(allocator, &.{ dir_path, "test.state" });
+    defer allocator.free(path);
+
+    var sim = Sim.init(.{ .allocator = allocator, .g = 2e-8, .dt = 0.01, .bounds = .{ 1.5, 1 } });
+    defer sim.deinit();
+    for (0..5) |i| {
+        const f: Real = @floatFromInt(i);
+        try sim.add(.{
+            .mass = 1 + f,
+            .radius = 0.01 * (1 + f),
+            .pos = .{ 0.1 * f, 0.2 * f },
+            .velocity = .{ -f, 0.5 * f },
+        });
+    }
+    try save(&sim, path);
+
+    const bytes = try tmp.dir.readFileAlloc(allocator, "test.state", 1 << 20);
+    defer allocator.free(bytes);
+    const header = std.mem.bytesToValue(Header, bytes[0..@sizeOf(Header)]);
+    try std.testing.expectEqualSlices(u8, &magic, &header.magic);
+    try std.testing.expectEqual(@as(u32, version), header.version);
+    try std.testing.expectEqual(@as(u64, 5), header.body_count);
+    try std.testing.expectEqual(@as(u32, @sizeOf(Real)), header.real_size);
+    try std.testing.expectEqual(@as(f64, sim.g), header.g);
+    try std.testing.expectEqual(@as(f64, sim.dt), header.dt);
+    try std.testing.expectEqual([2]f64{ 1.5, 1 }, header.bounds);
+
+    var loaded = Sim.init(.{ .allocator = allocator });
+    defer loaded.deinit();
+    try loaded.add(.{ .mass = 9, .radius = 9 });
+    try load(&loaded, path);
+    try std.testing.expectEqual(sim.g, loaded.g);
+    try std.testing.expectEqual(sim.dt, loaded.dt);
+    try std.testing.expectEqual(sim.bounds, loaded.bounds);
+    try std.testing.expectEqual(sim.bodies.len, loaded.bodies.len);
+    inline for (fields) |field| {
+        try std.testing.expectEqualSlices(Real, sim.bodies.items(field), loaded.bodies.items(field));
+    }
+    try std.testing.expectEqualSlices(Real, loaded.bodies.items(.x), loaded.bodies.items(.prev_x));
+}
+
+/// The bytes of a save state written by a build whose Real is `Stored`,
+/// holding `bodies`, each a value for every one of `fields`.
+fn testState(
+    comptime Stored: type,
+    header: Header,
+    bodies: []const [fields.len]f64,
+) ![]u8 {
+    var bytes = std.ArrayList(u8).init(std.testing.allocator);
+    errdefer bytes.deinit();
+    try bytes.appendSlice(std.mem.asBytes(&header));
+    for (0..fields.len) |field| {
+        for (bodies) |body| {
+            const value = precision.cast(Stored, body[field]);
+            try bytes.appendSlice(std.mem.asBytes(&value));
+        }
+    }
+    return bytes.toOwnedSlice();
+}
+
+test "load converts f32 states" {
+    const bodies = [_][fields.len]f64{
+        .{ 0.5, 0.25, -1, 2, 3, 0.125 },
+        .{ 1.5, 0.75, 0, -0.5, 1, 0.0625 },
+    };
+    const bytes = try testState(f32, .{
+        .body_count = bodies.len,
+        .g = 1e-8,
+        .dt = 0.5,
+        .bounds = .{ 2, 1 },
+        .real_size = 4,
+    }, &bodies);
+    defer std.testing.allocator.free(bytes);
+
+    var sim = Sim.init(.{ .allocator = std.testing.allocator });
+    defer sim.deinit();
+    try fromBytes(&sim, bytes);
+    try std.testing.expectEqual(@as(usize, bodies.len), sim.bodies.len);
+    inline for (fields, 0..) |field, f| {
+        for (sim.bodies.items(field), bodies) |value, body| {
+            try std.testing.expectEqual(precision.cast(Real, @as(f32, @floatCast(body[f]))), value);
+        }
+    }
+    try std.testing.expectEqual(@as(Real, 0.5), sim.dt);
+}
+
+test "load rejects corrupt headers and leaves the sim alone" {
+    const bodies = [_][fields.len]f64{.{ 0.5, 0.5, 0, 0, 1, 0.01 }};
+    const valid = Header{ .body_count = 1, .g = 1e-8, .dt = 0.01, .bounds = .{ 2, 1 } };
+
+    var sim = Sim.init(.{ .allocator = std.testing.allocator });
+    defer sim.deinit();
+    try sim.add(.{ .mass = 1, .radius = 0.01 });
+    try sim.add(.{ .mass = 2, .radius = 0.01 });
+
+    const Case = struct { header: Header, err: anyerror };
+    var cases = [_]Case{
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.UnsupportedSaveStateVersion },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+        .{ .header = valid, .err = error.InvalidSaveState },
+    };
+    cases[0].header.magic = "NBD1".*;
+    cases[1].header.version = version + 1;
+    cases[2].header.real_size = 2;
+    cases[3].header.body_count = 2;
+    cases[4].header.dt = 0;
+    cases[5].header.dt = -0.01;
+    cases[6].header.g = std.math.nan(f64);
+    cases[7].header.bounds[0] = -2;
+    cases[8].header.bounds[1] = std.math.inf(f64);
+
+    for (cases) |case| {
+        const bytes = try testState(Real, case.header, &bodies);
+        defer std.testing.allocator.free(bytes);
+        try std.testing.expectError(case.err, fromBytes(&sim, bytes));
+        try std.testing.expectEqual(@as(usize, 2), sim.bodies.len);
+    }
+
+    const bytes = try testState(Real, valid, &bodies);
+    defer std.testing.allocator.free(bytes);
+    try fromBytes(&sim, bytes);
+    try std.testing.expectEqual(@as(usize, 1), sim.bodies.len);
+}
@@ -0,0 +1,15 @@
+//! Root of `zig build test`. Pulls in every file with tests; none of them
+//! need raylib.
+
+test {
+    _ = @import("BarnesHut.zig");
+    _ = @import("Bodies.zig");
+    _ = @import("FastMultipole.zig");
+    _ = @import("fft.zig");
+    _ = @import("kernel.zig");
+    _ = @import("morton.zig");
+    _ = @import("ParticleMesh.zig");
+    _ = @import("savestate.zig");
+    _ = @import("Sim.zig");
+    _ = @import("SlotMap.zig");
+}